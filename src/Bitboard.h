@@ -38,6 +38,7 @@ BB bb_square[64];
 BB bb_rank[64];
 BB bb_file[64];
 BB bb_between[64][64];
+BB bb_line[64][64];
 BB passed_pawn_front_span[2][64];
 BB pawn_front_span[2][64];
 BB pawn_east_attack_span[2][64];
@@ -180,6 +181,26 @@ void initialize()
     king_attacks[sq] |= bbSquare(sq) >> 8;
     king_attacks[sq] |= (bbSquare(sq) & ~AFILE) >> 9;
   }
+  // The whole rank, file or diagonal through two squares, or 0 when they are
+  // not on one.
+  for (Square a = a1; a <= h8; a++) {
+    for (Square b = a1; b <= h8; b++) {
+      bb_line[a][b] = 0;
+
+      if (a == b) {
+        continue;
+      }
+      for (Square sq = a1; sq <= h8; sq++) {
+        int fa = a & 7, ra = a >> 3, fb = b & 7, rb = b >> 3, f = sq & 7, r = sq >> 3;
+
+        if ((ra == rb && r == ra) || (fa == fb && f == fa) || (ra - fa == rb - fb && r - f == ra - fa)
+            || (ra + fa == rb + fb && r + f == ra + fa))
+        {
+          bb_line[a][b] |= bbSquare(sq);
+        }
+      }
+    }
+  }
   corner_a1 = bbSquare(a1) | bbSquare(b1) | bbSquare(a2) | bbSquare(b2);
   corner_a8 = bbSquare(a8) | bbSquare(b8) | bbSquare(a7) | bbSquare(b7);
   corner_h1 = bbSquare(h1) | bbSquare(g1) | bbSquare(h2) | bbSquare(g2);
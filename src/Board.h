@@ -168,6 +168,22 @@ public:
             || isAttackedByKing(sq, side);
   }
 
+  // Like isAttacked, with sliders seeing through the given occupancy.
+  __forceinline bool isAttacked(const Square sq, const Side side, const BB& occupied) const {
+    return (rookAttacks(sq, occupied) & (piece[Rook + (side << 3)] | piece[Queen + (side << 3)]))
+           || (bishopAttacks(sq, occupied) & (piece[Bishop + (side << 3)] | piece[Queen + (side << 3)]))
+           || isAttackedByKnight(sq, side) || isAttackedByPawn(sq, side) || isAttackedByKing(sq, side);
+  }
+
+  // Returns the pieces of side that attack sq.
+  __forceinline BB attackers(const Square sq, const Side side) const {
+    return (rookAttacks(sq, occupied) & (piece[Rook + (side << 3)] | piece[Queen + (side << 3)]))
+           | (bishopAttacks(sq, occupied) & (piece[Bishop + (side << 3)] | piece[Queen + (side << 3)]))
+           | (piece[Knight + (side << 3)] & knight_attacks[sq])
+           | (piece[Pawn | (side << 3)] & pawn_captures[sq | ((side ^ 1) << 6)])
+           | (piece[King | (side << 3)] & king_attacks[sq]);
+  }
+
   __forceinline BB pieceAttacks(const Piece piece, const Square sq) const
   {
     switch (piece & 7) {
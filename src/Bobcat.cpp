@@ -21,6 +21,7 @@
 #include "Util.h"
 #include "Config.h"
 #include "Io.h"
+#include "Topology.h"
 #include "Square.h"
 #include "Bitboard.h"
 #include "Magic.h"
@@ -36,12 +37,17 @@
 #include "See.h"
 #include "Eval.h"
 #include "Protocol.h"
+#include "TimeManager.h"
+#include "SearchStats.h"
 #include "Search.h"
 #include "Book.h"
 #include "PgnPlayer.h"
 #include "Tune.h"
+#include "PerfCounters.h"
 #include "Test.h"
+#include "MicroBench.h"
 #include "Worker.h"
+#include "Supervisor.h"
 #include "Bobcat.h"
 
 int main(int argc, char* argv[]) {
@@ -18,16 +18,21 @@
 
 class Bobcat : public ProtocolListener {
 public:
-  Bobcat() : num_threads(1) {
+  Bobcat() : num_threads(1), bind_threads(false), abdada(false), deterministic(false),
+    multipv(1) {
+    STATS(total_stats.clear());
   }
 
   virtual ~Bobcat() {
   }
 
+  // The transposition table is cleared in the background while the GUI
+  // sends the position, the first search only waits for what is left.
   virtual int newGame() {
     game->newGame(Game::kStartPosition);
     pawnt->clear();
     transt->clear();
+    prepareTableInBackground();
     return 0;
   }
 
@@ -38,7 +43,7 @@ public:
   virtual int go(int wtime = 0, int btime = 0, int movestogo = 0, int winc = 0, int binc = 0, int movetime = 5000) {
     game->pos->pv_length = 0;
 
-    if (!protocol->isAnalysing() && !protocol->isFixedDepth()) {
+    if (protocol->isTimed() && !deterministic) {
       goBook();
     }
 
@@ -50,8 +55,11 @@ public:
       char best_move[12];
       char ponder_move[12];
 
-      protocol->postMoves(game->moveToString(search->pv[0][0].move, best_move),
-                          game->pos->pv_length > 1 ? game->moveToString(search->pv[0][1].move, ponder_move) : 0);
+      // The console benchmarks search silently.
+      if (search->verbosity > 0) {
+        protocol->postMoves(game->moveToString(search->pv[0][0].move, best_move),
+                            game->pos->pv_length > 1 ? game->moveToString(search->pv[0][1].move, ponder_move) : 0);
+      }
 
       game->makeMove(search->pv[0][0].move, true, true);
     }
@@ -59,11 +67,11 @@ public:
   }
 
   virtual void ponderHit() {
-    search->search_time += search->start_time.millisElapsed();
+    search->time_manager.ponderHit(search->start_time.millisElapsed());
   }
 
   virtual void stop() {
-    search->stop_search = true;
+    search->stop();
   }
 
   virtual bool makeMove(const char* m) {
@@ -88,20 +96,163 @@ public:
   }
 
   void goSearch(int wtime, int btime, int movestogo, int winc, int binc, int movetime) {
+    // The clock runs from here, so waiting for the table counts as thinking time.
+    Stopwatch go_time;
+
+    // A deterministic search starts from an empty table every time.
+    if (deterministic) {
+      transt->clear();
+    }
+
     // Shared transposition table
+    if (transt->prepareSearch(num_threads, bind_threads)) {
+      logTables();
+    }
+    SearchingTable* searching = abdada && searchThreads() > 1 ? searchingt : NULL;
+
+    if (searching) {
+      searching->clear();
+    }
+    node_counters->reset(searchThreads(), protocol->isFixedNodes() ? protocol->getNodes() : 0,
+                         searchThreads() == 1 ? 1 : 1024);
+    search->setSearchingTable(searching);
+    search->setNodeCounters(node_counters);
+    search->setMultiPV(multipv);
+    search->setSearchMoves(protocol->getSearchMoves(), protocol->getNumSearchMoves());
+
+    for (int i = 0; i < searchThreads() - 1; i++) {
+      workers[i].getSearch()->setSearchingTable(searching);
+      workers[i].getSearch()->setNodeCounters(node_counters);
+      workers[i].getSearch()->setSearchMoves(protocol->getSearchMoves(), protocol->getNumSearchMoves());
+    }
     startWorkers();
-    search->go(wtime, btime, movestogo, winc, binc, movetime, num_threads);
+    search->initialiseSearch(wtime, btime, movestogo, winc, binc, movetime);
+    search->start_time = go_time;
+    supervisor.start(search);
+    search->iterate();
+    supervisor.stop();
     stopWorkers();
+    selectBestThread();
+    STATS(collectStats());
+
+    // Have the table empty again by the next search.
+    if (deterministic) {
+      transt->clear();
+      prepareTableInBackground();
+    }
   }
 
-  void startWorkers() {
+  void prepareTableInBackground() {
+    if (transt->prepareInBackground(num_threads, bind_threads)) {
+      logTables();
+    }
+  }
+
+#if defined(SEARCH_STATS)
+  // Sums the statistics of all threads, reports them for this search and adds
+  // them to the totals shown by the stats command.
+  void collectStats() {
+    SearchStats stats;
+    stats.clear();
+    search->collectStats(stats);
+
+    for (int i = 0; i < searchThreads() - 1; i++) {
+      workers[i].getSearch()->collectStats(stats);
+    }
+    total_stats.add(stats);
+
+    if (search->verbosity > 0) {
+      stats.report([this](const char* line) { protocol->postInfoString(line); });
+    }
+  }
+#endif
+
+  // Every thread votes for the first move of its line with a weight that grows
+  // with depth and score. The deepest thread voting for the winning move gets
+  // its line played and reported. The master votes with its current line,
+  // which can be newer than its last completed iteration. With MultiPV the
+  // master's lines are kept as they are.
+  void selectBestThread() {
+    if (searchThreads() == 1 || multipv > 1 || game->pos->pv_length == 0) {
+      return;
+    }
+    Move moves[64];
+    int scores[64];
+    int depths[64];
+    int votes[64];
+    int n = 0;
+
+    moves[n] = search->pv[0][0].move;
+    scores[n] = search->pv[0][0].score;
+    depths[n++] = search->completed_depth;
+
+    for (int i = 0; i < searchThreads() - 1; i++) {
+      Search* helper = workers[i].getSearch();
+
+      if (helper->completed_pv_length) {
+        moves[n] = helper->completed_pv[0].move;
+        scores[n] = helper->completed_pv[0].score;
+        depths[n++] = helper->completed_depth;
+      }
+    }
+    int min_score = *std::min_element(scores, scores + n);
+
+    for (int i = 0; i < n; i++) {
+      votes[i] = 0;
+
+      for (int j = 0; j < n; j++) {
+        if (moves[j] == moves[i]) {
+          votes[i] += (scores[j] - min_score + 14)*depths[j];
+        }
+      }
+    }
+    int best = 0;
+
+    for (int i = 1; i < n; i++) {
+      if (votes[i] > votes[best] || (moves[i] == moves[best] && depths[i] > depths[best])) {
+        best = i;
+      }
+    }
+
+    if (best == 0) {
+      return;
+    }
+
+    for (int i = 0, k = 0; i < searchThreads() - 1; i++) {
+      Search* helper = workers[i].getSearch();
+
+      if (helper->completed_pv_length && ++k == best) {
+        search->takeCompletedLine(helper);
+        break;
+      }
+    }
+  }
+
+  void initialiseWorkers() {
     for (int i = 0; i < num_threads - 1; i++) {
-      workers[i].start(game, transt, pawnt);
+      workers[i].initialise(transt, pawnt, i + 1, bind_threads);
+    }
+  }
+
+  void exitWorkers() {
+    for (int i = 0; i < 64; i++) {
+      workers[i].exit();
+    }
+  }
+
+  // The deterministic mode searches with the master thread only.
+  int searchThreads() const {
+    return deterministic ? 1 : num_threads;
+  }
+
+  void startWorkers() {
+    for (int i = 0; i < searchThreads() - 1; i++) {
+      workers[i].start(game);
     }
   }
 
   void stopWorkers() {
-    for (int i = 0; i < num_threads - 1; i++) {
+    for (int i = 0; i < searchThreads() - 1; i++) {
       workers[i].stop();
     }
   }
@@ -112,17 +263,48 @@ public:
     if (value != NULL) {
       if (strieq("Hash", name)) {
         transt->initialise(std::min(65536, std::max(8, (int)strtol(value, NULL, 10))));
-        _snprintf(buf, sizeof(buf), "Hash:%d", transt->getSizeMb());
+        prepareTableInBackground();
+        snprintf(buf, sizeof(buf), "Hash:%d", transt->getSizeMb());
       }
       else if (strieq("Threads", name) || strieq("NumThreads", name)) {
         num_threads = std::min(64, std::max(1, (int)strtol(value, NULL, 10)));
-        _snprintf(buf, sizeof(buf), "Threads:%d", num_threads);
+        initialiseWorkers();
+        snprintf(buf, sizeof(buf), "Threads:%d", num_threads);
+      }
+      else if (strieq("Move Overhead", name)) {
+        search->time_manager.setMoveOverhead(std::min(5000, std::max(0, (int)strtol(value, NULL, 10))));
+        snprintf(buf, sizeof(buf), "Move Overhead:%d", search->time_manager.getMoveOverhead());
+      }
+      else if (strieq("BindThreads", name)) {
+        bind_threads = strieq(value, "true");
+        if (bind_threads) {
+          topology::bindThread(0);
+        }
+        else {
+          topology::unbindThread();
+        }
+        exitWorkers();
+        initialiseWorkers();
+        snprintf(buf, sizeof(buf), "BindThreads:%s (%d cpus, %d nodes)", bind_threads ? on : off,
+                  topology::num_cpus, topology::num_nodes);
+      }
+      else if (strieq("ABDADA", name)) {
+        abdada = strieq(value, "true");
+        snprintf(buf, sizeof(buf), "ABDADA:%s", abdada ? on : off);
+      }
+      else if (strieq("MultiPV", name)) {
+        multipv = std::min(32, std::max(1, (int)strtol(value, NULL, 10)));
+        snprintf(buf, sizeof(buf), "MultiPV:%d", multipv);
+      }
+      else if (strieq("Deterministic", name)) {
+        deterministic = strieq(value, "true");
+        snprintf(buf, sizeof(buf), "Deterministic:%s", deterministic ? on : off);
       }
       else if (strieq("UCI_Chess960", name)) {
         if (strieq(value, "true")) {
           game->chess960 = true;
         }
-        _snprintf(buf, sizeof(buf), "UCI_Chess960 ", game->chess960 ? on : off);
+        snprintf(buf, sizeof(buf), "UCI_Chess960:%s", game->chess960 ? on : off);
       }
       else if (strieq("UCI_Chess960_Arena", name)) {
         if (strieq(value, "true")) {
@@ -142,14 +324,21 @@ public:
     //setbuf(stdin, NULL);
 
     logger = new Logger();
-    config = new Config(argc > 1 ? argv[1] : "bobcat.ini");
+    // "bobcat bench [depth] [threads] [hash] [json] [perf]" runs the bench,
+    // "bobcat scaling [depth] [max threads] [json]" the thread scaling bench
+    // and "bobcat micro [json] [perf]" the kernel benchmarks, then exits.
+    bool bench_mode = argc > 1 && (strieq(argv[1], "bench") || strieq(argv[1], "scaling") ||
+                                   strieq(argv[1], "micro"));
+
+    config = new Config(argc > 1 && !bench_mode ? argv[1] : "bobcat.ini");
 
-    logTimeAndCwd();
+    logTimeAndCwd(!bench_mode);
 
     bitboard::initialize();
     attacks::initialize();
     zobrist::initialize();
     squares::initialize();
+    topology::initialize();
 
     game = new Game();
     input = new StdIn(logger);
@@ -158,15 +347,34 @@ public:
     book = new Book(config, logger);
     transt = new TranspositionTable(256);
     pawnt = new PawnStructureTable(8);
+    searchingt = new SearchingTable();
+    node_counters = new NodeCounters();
+    game->setTables(transt, pawnt);
     see = new See(game);
     eval = new Eval(*game, pawnt);
     search = new Search(protocol, game, eval, see, transt, logger);
+    supervisor.initialise(protocol, input);
 
-    newGame();
+    // The tables are new. The transposition table is allocated once the
+    // GUI has set the hash size.
+    game->newGame(Game::kStartPosition);
 
     bool console_mode = true;
     int exit = 0;
 
+    if (bench_mode) {
+      if (strieq(argv[1], "bench")) {
+        bench((const char**)argv + 2, argc - 2);
+      }
+      else if (strieq(argv[1], "scaling")) {
+        scaling((const char**)argv + 2, argc - 2);
+      }
+      else {
+        micro((const char**)argv + 2, argc - 2);
+      }
+      exit = 1;
+    }
+
     while (exit == 0) {
       game->pos->generateMoves();
 
@@ -197,10 +405,37 @@ public:
         game->print_moves();
       }
       else if (strieq(tokens[0], "perft")) {
-        Test(game).perft(6);
+        Test(game).perft(num_tokens > 1 ? std::max(1, (int)strtol(tokens[1], NULL, 10)) : 6);
       }
       else if (strieq(tokens[0], "timetodepth") || strieq(tokens[0], "ttd")) {
+        int saved_threads = num_threads;
+
+        if (num_tokens > 1) {
+          setOption("Threads", tokens[1]);
+        }
         Test(game).timeToDepth(search, this);
+        restoreOptions(saved_threads, transt->getSizeMb());
+      }
+      else if (strieq(tokens[0], "bench")) {
+        bench((const char**)tokens + 1, num_tokens - 1);
+      }
+      else if (strieq(tokens[0], "scaling")) {
+        scaling((const char**)tokens + 1, num_tokens - 1);
+      }
+      else if (strieq(tokens[0], "stats")) {
+#if defined(SEARCH_STATS)
+        if (num_tokens > 1 && strieq(tokens[1], "clear")) {
+          total_stats.clear();
+        }
+        else {
+          total_stats.report([](const char* line) { printf("%s\n", line); });
+        }
+#else
+        printf("Search statistics are not compiled in, build with -DSEARCH_STATS\n");
+#endif
+      }
+      else if (strieq(tokens[0], "micro")) {
+        micro((const char**)tokens + 1, num_tokens - 1);
       }
       else if (strieq(tokens[0], "divide")) {
         Test(game).perft_divide(5);
@@ -236,8 +471,7 @@ public:
         }
       }
       else if (strieq(tokens[0], "book")) {
-        char* fen;
-        game->getFen();
+        char* fen = game->getFen();
         BB key = book->hash(fen);
         char move[6];
         if (book->find(key, move) == 0) {
@@ -268,6 +502,8 @@ public:
         delete [] tokens[i];
       }
     }
+    exitWorkers();
+    supervisor.exit();
     delete logger;
     delete config;
     delete game;
@@ -278,11 +514,123 @@ public:
     delete eval;
     delete see;
     delete transt;
+    delete searchingt;
+    delete node_counters;
     delete search;
     return 0;
   }
 
-  void logTimeAndCwd() {
+  // Arguments are depth, threads and hash in that order, all optional,
+  // "json" anywhere to get the result as a JSON object and "perf" anywhere
+  // to add hardware counters. Threads and Hash are restored afterwards.
+  void bench(const char** args, int num_args) {
+    int depth = 12;
+    bool json = false;
+    PerfCounters* counters = NULL;
+    int k = 0;
+    int saved_threads = num_threads;
+    int saved_hash = transt->getSizeMb();
+
+    for (int i = 0; i < num_args; i++) {
+      if (strieq(args[i], "json")) {
+        json = true;
+      }
+      else if (strieq(args[i], "perf")) {
+        if (counters == NULL) {
+          counters = new PerfCounters();
+          counters->open();
+        }
+      }
+      else if (k == 0) {
+        depth = std::min(64, std::max(1, (int)strtol(args[i], NULL, 10)));
+        k++;
+      }
+      else if (k++ == 1) {
+        setOption("Threads", args[i]);
+      }
+      else {
+        setOption("Hash", args[i]);
+      }
+    }
+    Test(game).bench(search, this, depth, searchThreads(), transt->getSizeMb(), json, counters);
+    delete counters;
+    restoreOptions(saved_threads, saved_hash);
+    newGame();
+  }
+
+  // Arguments are depth and the maximum number of threads, by default all
+  // cpus, and "json" anywhere. Threads and Hash are restored afterwards.
+  void scaling(const char** args, int num_args) {
+    int depth = 12;
+    int max_threads = std::min(64, std::max(1, topology::num_cpus));
+    bool json = false;
+    int k = 0;
+
+    for (int i = 0; i < num_args; i++) {
+      if (strieq(args[i], "json")) {
+        json = true;
+      }
+      else if (k++ == 0) {
+        depth = std::min(64, std::max(1, (int)strtol(args[i], NULL, 10)));
+      }
+      else {
+        max_threads = std::min(64, std::max(1, (int)strtol(args[i], NULL, 10)));
+      }
+    }
+    bool saved_deterministic = deterministic;
+    int saved_threads = num_threads;
+    int saved_hash = transt->getSizeMb();
+    deterministic = false;
+    Test(game).scaling(search, this, depth, max_threads, json);
+    deterministic = saved_deterministic;
+    restoreOptions(saved_threads, saved_hash);
+    newGame();
+  }
+
+  // Sets Threads and Hash back to the values they had before a bench command
+  // changed them.
+  void restoreOptions(int threads, int hash_mb) {
+    char value[12];
+
+    if (threads != num_threads) {
+      snprintf(value, sizeof(value), "%d", threads);
+      setOption("Threads", value);
+    }
+
+    if (hash_mb != transt->getSizeMb()) {
+      snprintf(value, sizeof(value), "%d", hash_mb);
+      setOption("Hash", value);
+    }
+  }
+
+  // Arguments are "json" and "perf" in any order.
+  void micro(const char** args, int num_args) {
+    bool json = false;
+    PerfCounters* counters = NULL;
+
+    for (int i = 0; i < num_args; i++) {
+      if (strieq(args[i], "json")) {
+        json = true;
+      }
+      else if (strieq(args[i], "perf") && counters == NULL) {
+        counters = new PerfCounters();
+        counters->open();
+      }
+    }
+    MicroBench(game, eval, see, counters).run(json);
+    delete counters;
+    // The corpus replaced the game, but the tables are left as they were.
+    game->newGame(Game::kStartPosition);
+  }
+
+  void logTables() {
+    char buf[2048];
+    snprintf(buf, sizeof(buf), "Transposition table is %d MB using %s, pawn structure table uses %s.",
+             transt->getSizeMb(), transt->getPageMode(), pawnt->getPageMode());
+    logger->logts(buf);
+  }
+
+  void logTimeAndCwd(bool print_cwd) {
     char buf1[2048];
     char buf2[2048];
 
@@ -293,7 +641,9 @@ public:
     logger->logts(buf1);
     snprintf(buf1, sizeof(buf1), "Working directory is %s.", _getcwd(buf2, 2048));
     logger->logts(buf1);
-    printf("%s\n",buf1);
+    if (print_cwd) {
+      printf("%s\n",buf1);
+    }
   }
 
 public:
@@ -309,8 +659,18 @@ public:
   Book* book;
   TTable* transt;
   PSTable* pawnt;
+  SearchingTable* searchingt;
   Worker workers[64];
+  Supervisor supervisor;
+  NodeCounters* node_counters;
+#if defined(SEARCH_STATS)
+  SearchStats total_stats; // since start or "stats clear"
+#endif
   int num_threads;
+  bool bind_threads;
+  bool abdada;
+  bool deterministic;
+  int multipv;
 
   static const char* on;
   static const char* off;
@@ -15,19 +15,46 @@
   You should have received a copy of the GNU General Public License
   along with Bobcat.  If not, see <http://www.gnu.org/licenses/>.
 */
+#if defined(_WIN32)
 #define _WIN32_WINNT 0x0600
 #include <windows.h>
 #include <sys/timeb.h>
 #include <intrin.h>
+#include <conio.h>
+#include <malloc.h>
+#else
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#define _getcwd getcwd
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 #define __USE_MINGW_ANSI_STDIO 1
 
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <algorithm>
-#include <conio.h>
+#include <random>
 #include <math.h>
 #include <assert.h>
 
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 #ifdef __forceinline
 #undef __forceinline
 #endif
@@ -18,7 +18,9 @@
 
 class Game {
 public:
-  Game() : position_list(new Position[2000]), pos(position_list), chess960(false), xfen(false) {
+  Game() : position_list(new Position[2000]), pos(position_list), chess960(false), xfen(false), transt(NULL),
+    pawnt(NULL)
+  {
     for (int i = 0; i < 2000; i++) {
       position_list[i].board = &board;
     }
@@ -41,19 +43,8 @@ public:
     }
     Position* prev = pos++;
     pos->side_to_move = prev->side_to_move ^ 1;
-    pos->material = prev->material;
     pos->last_move = m;
-    if (calculate_in_check) {
-      pos->in_check = board.isAttacked(board.king_square[pos->side_to_move], pos->side_to_move ^ 1);
-    }
     pos->castle_rights = prev->castle_rights & castle_rights_mask[moveFrom(m)] & castle_rights_mask[moveTo(m)];
-    pos->null_moves_in_row = 0;
-    if (isCapture(m) || (movePiece(m) & 7) == Pawn) {
-      pos->reversible_half_move_count = 0;
-    }
-    else {
-      pos->reversible_half_move_count = prev->reversible_half_move_count + 1;
-    }
     if (moveType(m) & DOUBLEPUSH) {
       pos->en_passant_square = bbSquare(moveTo(m) + pawn_push_dist[pos->side_to_move]);
     }
@@ -63,6 +54,18 @@ public:
     pos->key = prev->key;
     pos->pawn_structure_key = prev->pawn_structure_key;
     updateKey(m);
+    // The rest of the move overlaps with the table fetches started in updateKey.
+    pos->material = prev->material;
+    if (calculate_in_check) {
+      pos->in_check = board.isAttacked(board.king_square[pos->side_to_move], pos->side_to_move ^ 1);
+    }
+    pos->null_moves_in_row = 0;
+    if (isCapture(m) || (movePiece(m) & 7) == Pawn) {
+      pos->reversible_half_move_count = 0;
+    }
+    else {
+      pos->reversible_half_move_count = prev->reversible_half_move_count + 1;
+    }
     pos->material.makeMove(m);
     return true;
   }
@@ -121,6 +124,7 @@ public:
     }
     if (!m) {
       pos->key ^= pos->pawn_structure_key;
+      prefetch();
       return;
     }
     // from and to for moving piece
@@ -165,6 +169,21 @@ public:
       pos->key ^= zobrist_pcsq[piece][rook_castles_to[moveTo(m)]];
     }
     pos->key ^= pos->pawn_structure_key;
+    prefetch();
+  }
+
+  __forceinline void prefetch() {
+    if (transt) {
+      transt->prefetch(pos->key);
+    }
+    if (pawnt) {
+      pawnt->prefetch(pos->pawn_structure_key);
+    }
+  }
+
+  void setTables(TTable* transt, PSTable* pawnt) {
+    this->transt = transt;
+    this->pawnt = pawnt;
   }
 
   __forceinline  bool isRepetition() {
@@ -366,11 +385,7 @@ public:
       memcpy(p, "- ", 2);
       p += 2;
     }
-    memset(buf, 0, 12);
-    memcpy(p, itoa(pos->reversible_half_move_count, buf, 10), 12);
-    p[strlen(p)] = ' ';
-    memset(buf, 0, 12);
-    memcpy(p + strlen(p), itoa(static_cast<int>((pos - position_list)/2 + 1), buf, 10), 12);
+    snprintf(p, fen + sizeof(fen) - p, "%d %d", pos->reversible_half_move_count, static_cast<int>((pos - position_list)/2 + 1));
     return fen;
   }
 
@@ -520,9 +535,11 @@ public:
     chess960 = other->chess960;
     xfen = other->xfen;
 
-    pos += (other->pos - other->position_list);
+    int ply = static_cast<int>(other->pos - other->position_list);
+    pos = position_list + ply;
 
-    for (int i = 0; i < 2000; i++) {
+    // Only the positions reachable by the repetition check are needed.
+    for (int i = std::max(0, ply - other->pos->reversible_half_move_count); i <= ply; i++) {
       position_list[i] = other->position_list[i];
       position_list[i].board = &board;
     }
@@ -571,6 +588,8 @@ public:
   Board board;
   bool chess960;
   bool xfen;
+  TTable* transt;
+  PSTable* pawnt;
 
   static const char kStartPosition[];
 };
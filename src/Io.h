@@ -15,6 +15,11 @@
   You should have received a copy of the GNU General Public License
   along with Bobcat.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <string>
 
 class Logger {
 public:
@@ -34,13 +39,16 @@ public:
     }
   }
 
+  // Input is logged by the supervisor while the search logs its output.
   void logts(const char* text) {
+    std::lock_guard<std::mutex> lock(mutex);
     char buf1[4096], buf2[64];
     snprintf(buf1, sizeof(buf1), "%s %s", timeString(buf2), text);
     writeLine(buf1);
   }
 
   void logts(const char* text1, const char* text2) {
+    std::lock_guard<std::mutex> lock(mutex);
     char buf1[4096], buf2[64];
     snprintf(buf1, sizeof(buf1), "%s %s%s", timeString(buf2), text1, text2);
     writeLine(buf1);
@@ -71,6 +79,7 @@ protected:
 
   FILE* file;
   char* logfile;
+  std::mutex mutex;
 };
 
 class StdIn {
@@ -80,25 +89,96 @@ public:
     this->logger = logger;
   }
 
+  ~StdIn() {
+#if !defined(_WIN32)
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+#endif
+  }
+
+  // A non-blocking read only looks at new input, a blocking read first
+  // returns the lines that were put back.
   int getLine(bool blocking, char* line) {
     line[0] = '\0';
+    if (blocking && !pending.empty()) {
+      strcpy(line, pending.front().c_str());
+      pending.pop_front();
+      return 1;
+    }
     if (!blocking) {
-      if (!isAvailable()) {
+      if (eof || !isAvailable()) {
         return 0;
       }
     }
-    getLine(line, 16384, stdin);
+    if (getLine(line, 16384, stdin) < 0) {
+      if (blocking) {
+        exit(1);
+      }
+      return 0;
+    }
     return 1;
   }
 
+  // Keeps a line that was read during a search for the command loop.
+  void putBack(const char* line) {
+    pending.push_back(line);
+  }
+
+  // Waits until input is available, interruptWait() is called or the timeout
+  // expires. A negative timeout waits without limit. Returns true if there is
+  // input to read.
+  bool waitForInput(int64_t micros) {
+#if defined(_WIN32)
+    // Pipes and consoles can not be waited on together here, so poll them.
+    std::unique_lock<std::mutex> lock(wait_mutex);
+    if (micros < 0 || micros > POLL_MICROS) {
+      micros = POLL_MICROS;
+    }
+    wait_cond.wait_for(lock, std::chrono::microseconds(micros), [this] { return interrupted; });
+    interrupted = false;
+    return !eof && isAvailable() != 0;
+#else
+    struct pollfd fds[2] = { { eof ? -1 : fileno(stdin), POLLIN, 0 }, { wake_pipe[0], POLLIN, 0 } };
+#if defined(__linux__)
+    struct timespec ts = { (time_t)(micros/1000000), (long)(micros%1000000)*1000 };
+    int n = ppoll(fds, 2, micros < 0 ? NULL : &ts, NULL);
+#else
+    int n = poll(fds, 2, micros < 0 ? -1 : (int)((micros + 999)/1000));
+#endif
+    if (n > 0 && (fds[1].revents & POLLIN)) {
+      char buf[64];
+      if (read(wake_pipe[0], buf, sizeof(buf)) < 0) {
+        return false;
+      }
+    }
+    return n > 0 && (fds[0].revents & (POLLIN|POLLHUP));
+#endif
+  }
+
+  // Makes a pending or the next call to waitForInput return.
+  void interruptWait() {
+#if defined(_WIN32)
+    std::lock_guard<std::mutex> lock(wait_mutex);
+    interrupted = true;
+    wait_cond.notify_one();
+#else
+    if (write(wake_pipe[1], "", 1) < 0) {
+      return;
+    }
+#endif
+  }
+
 protected:
   StdIn() {
   }
 
+#if defined(_WIN32)
   void initialise() {
     DWORD dw;
     handle = GetStdHandle(STD_INPUT_HANDLE);
     is_pipe = !GetConsoleMode(handle, &dw);
+    interrupted = false;
+    eof = false;
   }
 
   int isAvailable() {
@@ -111,6 +191,23 @@ protected:
     }
     return _kbhit();
   }
+#else
+  void initialise() {
+    // Unbuffered, so that poll() sees every line that has not been read yet.
+    setvbuf(stdin, NULL, _IONBF, 0);
+    eof = false;
+
+    if (pipe(wake_pipe) == 0) {
+      fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+      fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+    }
+  }
+
+  int isAvailable() {
+    struct pollfd fd = { fileno(stdin), POLLIN, 0 };
+    return poll(&fd, 1, 0) > 0 && (fd.revents & (POLLIN|POLLHUP));
+  }
+#endif
 
   int getLine(char* line, int size, FILE* stream) {
     int c;
@@ -118,7 +215,8 @@ protected:
     do {
       c = fgetc(stream);
       if (c == EOF) {
-        exit(1);
+        eof = true;
+        return -1;
       }
       else if (c == '\n') {
         break;
@@ -134,8 +232,19 @@ protected:
     return len;
   }
 
+#if defined(_WIN32)
   HANDLE handle;
   bool is_pipe;
+  std::mutex wait_mutex;
+  std::condition_variable wait_cond;
+  bool interrupted;
+
+  static const int64_t POLL_MICROS = 1000;
+#else
+  int wake_pipe[2];
+#endif
+  std::deque<std::string> pending;
+  bool eof;
   Logger* logger;
 };
 
@@ -246,7 +246,7 @@ void initialize()
     BB temp = magicmoves_b_mask[i];
     while (temp)
     {
-      BB bit = temp & -(__int64)temp;
+      BB bit = temp & -(int64_t)temp;
       squares[numsquares++] =
         initmagicmoves_bitpos64_database[(bit *
                                           0x07EDD5E59A4E28C2ULL) >> 58];
@@ -268,7 +268,7 @@ void initialize()
     BB temp = magicmoves_r_mask[i];
     while (temp)
     {
-      BB bit = temp & -(__int64)temp;
+      BB bit = temp & -(int64_t)temp;
       squares[numsquares++] =
         initmagicmoves_bitpos64_database[(bit *
                                           0x07EDD5E59A4E28C2ULL) >> 58];
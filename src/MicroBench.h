@@ -0,0 +1,372 @@
+/*
+  This file is part of Bobcat.
+  Copyright 2008-2015 Gunnar Harms
+
+  Bobcat is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Bobcat is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Bobcat.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Measures the cost per call of the search kernels in isolation. The corpus
+// is the bench positions plus positions reached from them by random playouts,
+// so openings, middlegames and simplified positions are all represented.
+class MicroBench : public MoveSorter
+{
+public:
+  // Hardware counters are reported per op when counters is not NULL.
+  MicroBench(Game* game, Eval* eval, See* see, PerfCounters* counters) :
+    game(game), eval(eval), see(see), counters(counters), num_results(0)
+  {
+    createCorpus();
+  }
+
+  // Scores moves with a cheap hash so that move selection has work to do.
+  virtual void sortMove(MoveData& move_data)
+  {
+    move_data.score = (int)((move_data.move*2654435761u) >> 16);
+  }
+
+  void run(bool json)
+  {
+    benchGenerateMoves();
+    benchNextMove();
+    benchMakeMove();
+    benchEvaluate();
+    benchSee();
+    benchTransposition();
+    benchAttacks();
+    benchMaterial();
+
+    if (json) {
+      printf("{\n  \"positions\": %d,\n  \"kernels\": [\n", num_positions);
+      for (int i = 0; i < num_results; i++) {
+        printf("    {\"name\": \"%s\", \"ops\": %" PRIu64 ", \"ns_per_op\": %.2f, \"cycles_per_op\": %.2f",
+               results[i].name, results[i].ops, nsPerOp(results[i]), cyclesPerOp(results[i]));
+        if (counters && counters->numAvailable()) {
+          printf(", \"counters_per_op\": ");
+          counters->printJson(results[i].counts, results[i].ops);
+        }
+        printf("}%s\n", i < num_results - 1 ? "," : "");
+      }
+      printf("  ]\n}\n");
+    }
+    else {
+      printf("%d positions\n", num_positions);
+      printf("Kernel                         ops     ns/op  cycles/op\n");
+      for (int i = 0; i < num_results; i++) {
+        printf("%-20s %13" PRIu64 " %9.2f %10.2f\n", results[i].name, results[i].ops, nsPerOp(results[i]),
+               cyclesPerOp(results[i]));
+      }
+      if (counters && counters->numAvailable()) {
+        printf("\nPer op             ");
+        PerfCounters::printHeader();
+        printf("\n");
+        for (int i = 0; i < num_results; i++) {
+          printf("%-20s", results[i].name);
+          counters->printRow(results[i].counts, results[i].ops);
+          printf("\n");
+        }
+      }
+      else if (counters) {
+        printf("\nPerformance counters are not available: %s\n", counters->errorString());
+      }
+    }
+  }
+
+private:
+  struct Result {
+    const char* name;
+    uint64_t ops;
+    uint64_t nanos;
+    uint64_t cycles;
+    uint64_t counts[PerfCounters::NUM_COUNTERS];
+  };
+
+  // Times a batch of calls on the current position and adds it to the result.
+  class Timer {
+  public:
+    Timer(Result& result, PerfCounters* counters) : result(result), counters(counters)
+    {
+      if (counters) {
+        counters->clear();
+        counters->start();
+      }
+      cycles = cycleCounter();
+      sw.start();
+    }
+
+    ~Timer()
+    {
+      result.cycles += cycleCounter() - cycles;
+      result.nanos += sw.nanosElapsedHighRes();
+      if (counters) {
+        counters->stop();
+        for (int i = 0; i < PerfCounters::NUM_COUNTERS; i++) {
+          result.counts[i] += counters->value(i);
+        }
+      }
+    }
+
+  private:
+    Result& result;
+    PerfCounters* counters;
+    Stopwatch sw;
+    uint64_t cycles;
+  };
+
+  static const int MAX_POSITIONS = 160;
+  static const int REPETITIONS = 500;
+
+  void createCorpus()
+  {
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    num_positions = 0;
+
+    for (int i = 0; i < NUM_BENCH_POSITIONS; i++) {
+      game->newGame(bench_positions[i]);
+      for (int ply = 0; ply <= 48 && num_positions < MAX_POSITIONS; ply++) {
+        if (ply % 8 == 0) {
+          strncpy(corpus[num_positions++], game->getFen(), sizeof(corpus[0]) - 1);
+        }
+        Position* pos = game->pos;
+        pos->generateMoves(0, 0, LEGALMOVES);
+        if (pos->moveCount() == 0) {
+          break;
+        }
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        game->makeMove(pos->move_list[seed % pos->moveCount()].move, false, true);
+      }
+    }
+  }
+
+  Result& newResult(const char* name)
+  {
+    Result& result = results[num_results++];
+    result.name = name;
+    result.ops = result.nanos = result.cycles = 0;
+    memset(result.counts, 0, sizeof(result.counts));
+    return result;
+  }
+
+  void benchGenerateMoves()
+  {
+    Result& result = newResult("generateMoves");
+    for (int i = 0; i < num_positions; i++) {
+      game->newGame(corpus[i]);
+      Timer timer(result, counters);
+      for (int k = 0; k < REPETITIONS; k++) {
+        game->pos->generateMoves(0, 0, 0);
+        keep(game->pos->moveCount());
+      }
+      result.ops += REPETITIONS;
+    }
+  }
+
+  void benchNextMove()
+  {
+    Result& result = newResult("nextMove");
+    for (int i = 0; i < num_positions; i++) {
+      game->newGame(corpus[i]);
+      Position* pos = game->pos;
+      pos->generateMoves(this, 0, 0);
+      Timer timer(result, counters);
+      for (int k = 0; k < REPETITIONS; k++) {
+        pos->gotoMove(0);
+        while (const MoveData* move_data = pos->nextMove()) {
+          keep(move_data->move);
+        }
+      }
+      result.ops += (uint64_t)REPETITIONS*pos->moveCount();
+    }
+  }
+
+  void benchMakeMove()
+  {
+    Result& result = newResult("makeMove+unmakeMove");
+    for (int i = 0; i < num_positions; i++) {
+      game->newGame(corpus[i]);
+      Move moves[256];
+      int num_moves = getMoves(moves);
+      Timer timer(result, counters);
+      for (int k = 0; k < REPETITIONS; k++) {
+        for (int j = 0; j < num_moves; j++) {
+          if (game->makeMove(moves[j], true, true)) {
+            game->unmakeMove();
+          }
+        }
+      }
+      result.ops += (uint64_t)REPETITIONS*num_moves;
+    }
+  }
+
+  void benchEvaluate()
+  {
+    Result& result = newResult("Eval::evaluate");
+    for (int i = 0; i < num_positions; i++) {
+      game->newGame(corpus[i]);
+      Timer timer(result, counters);
+      for (int k = 0; k < REPETITIONS; k++) {
+        keep(eval->evaluate(-100000, 100000));
+      }
+      result.ops += REPETITIONS;
+    }
+  }
+
+  void benchSee()
+  {
+    Result& result = newResult("See::seeMove");
+    for (int i = 0; i < num_positions; i++) {
+      game->newGame(corpus[i]);
+      Move moves[256];
+      int num_moves = getMoves(moves);
+      int num_captures = 0;
+      for (int j = 0; j < num_moves; j++) {
+        if (isCapture(moves[j])) {
+          moves[num_captures++] = moves[j];
+        }
+      }
+      Timer timer(result, counters);
+      for (int k = 0; k < REPETITIONS; k++) {
+        for (int j = 0; j < num_captures; j++) {
+          keep(see->seeMove(moves[j]));
+        }
+      }
+      result.ops += (uint64_t)REPETITIONS*num_captures;
+    }
+  }
+
+  // Random keys into a table of its own, far larger than the caches, so most
+  // probes miss the cache the way they do in a search. The engine's table is
+  // left as it is.
+  void benchTransposition()
+  {
+    static const int NUM_KEYS = 1 << 16;
+    static const int TABLE_MB = 64;
+    Result& insert_result = newResult("TTable::insert");
+    Result& find_result = newResult("TTable::find");
+    uint64_t* keys = new uint64_t[NUM_KEYS];
+    uint64_t seed = 0x2545f4914f6cdd1dull;
+
+    for (int i = 0; i < NUM_KEYS; i++) {
+      seed ^= seed << 13;
+      seed ^= seed >> 7;
+      seed ^= seed << 17;
+      keys[i] = seed;
+    }
+    TTable table(TABLE_MB);
+    table.prepareSearch(1, false);
+    {
+      Timer timer(insert_result, counters);
+      for (int i = 0; i < NUM_KEYS; i++) {
+        table.insert(keys[i], i & 63, i & 1023, 1 + (i & 3), 0, i & 511);
+      }
+      insert_result.ops += NUM_KEYS;
+    }
+    {
+      Timer timer(find_result, counters);
+      Transposition transp;
+      for (int i = 0; i < NUM_KEYS; i++) {
+        keep(table.find(keys[i], transp));
+      }
+      find_result.ops += NUM_KEYS;
+    }
+    delete [] keys;
+  }
+
+  void benchAttacks()
+  {
+    Result& bishop_result = newResult("bishopAttacks");
+    Result& rook_result = newResult("rookAttacks");
+    for (int i = 0; i < num_positions; i++) {
+      game->newGame(corpus[i]);
+      const BB occupied = game->board.occupied;
+      {
+        Timer timer(bishop_result, counters);
+        for (int k = 0; k < REPETITIONS; k++) {
+          for (int sq = 0; sq < 64; sq++) {
+            keep(bishopAttacks(sq, occupied));
+          }
+        }
+      }
+      {
+        Timer timer(rook_result, counters);
+        for (int k = 0; k < REPETITIONS; k++) {
+          for (int sq = 0; sq < 64; sq++) {
+            keep(rookAttacks(sq, occupied));
+          }
+        }
+      }
+      bishop_result.ops += REPETITIONS*64;
+      rook_result.ops += REPETITIONS*64;
+    }
+  }
+
+  void benchMaterial()
+  {
+    Result& result = newResult("Material::evaluate");
+    for (int i = 0; i < num_positions; i++) {
+      game->newGame(corpus[i]);
+      Position* pos = game->pos;
+      Timer timer(result, counters);
+      for (int k = 0; k < REPETITIONS; k++) {
+        int flags = 0;
+        keep(pos->material.evaluate(flags, 0, pos->side_to_move, &game->board));
+      }
+      result.ops += REPETITIONS;
+    }
+  }
+
+  int getMoves(Move* moves)
+  {
+    int num_moves = 0;
+    Position* pos = game->pos;
+    pos->generateMoves(0, 0, 0);
+    while (const MoveData* move_data = pos->nextMove()) {
+      moves[num_moves++] = move_data->move;
+    }
+    return num_moves;
+  }
+
+  // Makes the compiler produce the value without storing it anywhere, and
+  // stops it from moving loop invariant work out of the timed loops.
+  template <typename T>
+  __forceinline void keep(const T value)
+  {
+#if defined(_MSC_VER)
+    sink ^= (uint64_t)value;
+#else
+    asm volatile("" : : "r"(value) : "memory");
+#endif
+  }
+
+  static double nsPerOp(const Result& result)
+  {
+    return result.ops ? (double)result.nanos/result.ops : 0;
+  }
+
+  static double cyclesPerOp(const Result& result)
+  {
+    return result.ops ? (double)result.cycles/result.ops : 0;
+  }
+
+  Game* game;
+  Eval* eval;
+  See* see;
+  PerfCounters* counters;
+  char corpus[MAX_POSITIONS][128];
+  int num_positions;
+  Result results[16];
+  int num_results;
+  volatile uint64_t sink;
+};
@@ -43,7 +43,7 @@ public:
   }
 
   __forceinline void generateCapturesAndPromotions(MoveSorter* sorter) {
-    reset(sorter, 0, QUEENPROMOTION|STAGES);
+    reset(sorter, 0, QUEENPROMOTION|STAGES|LEGALMOVES);
     max_stage = 2;
     stage = 1;
   }
@@ -115,11 +115,21 @@ public:
     iteration = pos;
   }
 
+  // Tests a move from elsewhere, such as the transposition move, against the
+  // position. Directions and promotions are fixed by how the move was encoded,
+  // so only the side, the pieces and the squares passed over are checked.
   __forceinline bool isPseudoLegal(const Move m) {
-    // TO DO en passant moves and castle moves
-    if ((bb_piece[movePiece(m)] & bbSquare(moveFrom(m))) == 0) {
+    if (moveSide(m) != side_to_move || (bb_piece[movePiece(m)] & bbSquare(moveFrom(m))) == 0) {
       return false;
     }
+    if (isCastleMove(m)) {
+      return !in_check
+             && ((moveTo(m) == oo_king_to[side_to_move] && canCastleShort())
+                 || (moveTo(m) == ooo_king_to[side_to_move] && canCastleLong()));
+    }
+    if (isEpCapture(m)) {
+      return (en_passant_square & bbSquare(moveTo(m))) != 0;
+    }
     if (isCapture(m)) {
       const BB& bb_to = bbSquare(moveTo(m));
       if ((occupied_by_side[moveSide(m) ^ 1] & bb_to) == 0) {
@@ -133,7 +143,7 @@ public:
       return false;
     }
     Piece piece = movePiece(m) & 7;
-    if (piece == Bishop || piece == Rook || piece == Queen) {
+    if (piece == Bishop || piece == Rook || piece == Queen || (moveType(m) & DOUBLEPUSH)) {
       if (bb_between[moveFrom(m)][moveTo(m)] & occupied) {
         return false;
       }
@@ -148,27 +158,20 @@ private:
     this->sorter = sorter;
     this->transp_move = move;
     this->flags = flags;
-
-    if (move) {
-      if (isCastleMove(this->transp_move) || isEpCapture(this->transp_move)) {
-        // needed because isPseudoLegal() is not complete yet.
-        this->transp_move = 0;
-        this->flags &= ~STAGES;
-      }
-    }
     iteration = 0;
     number_moves = 0;
     stage = 0;
-    if (flags & LEGALMOVES) {
-      pinned = board->getPinnedPieces(side_to_move, board->king_square[side_to_move]);
-    }
+    king_square = board->king_square[side_to_move];
+    checkers = in_check ? board->attackers(king_square, side_to_move ^ 1) : 0;
+    check_mask = checkMask();
+    pinned = (flags & LEGALMOVES) ? board->getPinnedPieces(side_to_move, king_square) : 0;
     occupied = board->occupied;
     occupied_by_side = board->occupied_by_side;
     bb_piece = board->piece;
   }
 
   __forceinline void generateTranspositionMove() {
-    if (transp_move && isPseudoLegal(transp_move)) {
+    if (transp_move && isPseudoLegal(transp_move) && ((flags & LEGALMOVES) == 0 || isLegal(transp_move))) {
       move_list[number_moves].score = 890010;
       move_list[number_moves++].move = transp_move;
     }
@@ -176,7 +179,12 @@ private:
   }
 
   void generateCapturesAndPromotions() {
-    addMoves(occupied_by_side[side_to_move ^ 1]);
+    if (in_check) {
+      addEvasions(occupied_by_side[side_to_move ^ 1]);
+    }
+    else {
+      addMoves(occupied_by_side[side_to_move ^ 1]);
+    }
     const BB& pawns = board->pawns(side_to_move);
     addPawnMoves(pawnPush[side_to_move](pawns & rank_7[side_to_move]) & ~occupied, pawn_push_dist, QUIET);
     addPawnMoves(pawnWestAttacks[side_to_move](pawns) & occupied_by_side[side_to_move ^ 1], pawn_west_attack_dist, CAPTURE);
@@ -199,7 +207,12 @@ private:
     BB pushed = pawnPush[side_to_move](board->pawns(side_to_move) & ~rank_7[side_to_move]) & ~occupied;
     addPawnMoves(pushed, pawn_push_dist, QUIET);
     addPawnMoves(pawnPush[side_to_move](pushed & rank_3[side_to_move]) & ~occupied, pawn_double_push_dist, DOUBLEPUSH);
-    addMoves(~occupied);
+    if (in_check) {
+      addEvasions(~occupied);
+    }
+    else {
+      addMoves(~occupied);
+    }
     stage++;
   }
 
@@ -222,7 +235,7 @@ private:
       return;
     }
 
-    if ((flags & LEGALMOVES) && !isLegal(move, piece, from, type)) {
+    if ((type & EPCAPTURE) && (flags & LEGALMOVES) && !isLegalEpCapture(move)) {
       return;
     }
     MoveData& move_data = move_list[number_moves++];
@@ -240,28 +253,51 @@ private:
     BB bb;
     int offset = side_to_move << 3;
     Square from;
-    for (bb = bb_piece[Queen + offset]; bb; resetLSB(bb)) {
-      from = lsb(bb);
-      addMoves(Queen + offset, from, queenAttacks(from, board->occupied) & to_squares);
-    }
-    for (bb = bb_piece[Rook + offset]; bb; resetLSB(bb)) {
-      from = lsb(bb);
-      addMoves(Rook + offset, from, rookAttacks(from, board->occupied) & to_squares);
-    }
-    for (bb = bb_piece[Bishop + offset]; bb; resetLSB(bb)) {
-      from = lsb(bb);
-      addMoves(Bishop + offset, from, bishopAttacks(from, board->occupied) & to_squares);
-    }
-    for (bb = bb_piece[Knight + offset]; bb; resetLSB(bb)) {
-      from = lsb(bb);
-      addMoves(Knight + offset, from, knightAttacks(from) & to_squares);
+    const BB targets = to_squares & check_mask;
+
+    if (targets) {
+      for (bb = bb_piece[Queen + offset]; bb; resetLSB(bb)) {
+        from = lsb(bb);
+        addMoves(Queen + offset, from, queenAttacks(from, board->occupied) & targets & pinMask(from));
+      }
+      for (bb = bb_piece[Rook + offset]; bb; resetLSB(bb)) {
+        from = lsb(bb);
+        addMoves(Rook + offset, from, rookAttacks(from, board->occupied) & targets & pinMask(from));
+      }
+      for (bb = bb_piece[Bishop + offset]; bb; resetLSB(bb)) {
+        from = lsb(bb);
+        addMoves(Bishop + offset, from, bishopAttacks(from, board->occupied) & targets & pinMask(from));
+      }
+      for (bb = bb_piece[Knight + offset] & ~pinned; bb; resetLSB(bb)) {
+        from = lsb(bb);
+        addMoves(Knight + offset, from, knightAttacks(from) & targets);
+      }
     }
     for (bb = bb_piece[King + offset]; bb; resetLSB(bb)) {
       from = lsb(bb);
-      addMoves(King + offset, from, kingAttacks(from) & to_squares);
+      BB to = kingAttacks(from) & to_squares;
+      addMoves(King + offset, from, (flags & LEGALMOVES) ? safeKingSquares(from, to) : to);
     }
   }
 
+  // In check the king moves to safe squares. With a single checker the other
+  // pieces may also capture it or block its ray, so they are found from those
+  // few squares instead of from every piece. Pinned pieces can never help.
+  __forceinline void addEvasions(const BB& to_squares) {
+    if ((checkers & (checkers - 1)) == 0) {
+      const BB movers = occupied_by_side[side_to_move] & ~pinned
+                        & ~(bb_piece[Pawn + (side_to_move << 3)] | bb_piece[King + (side_to_move << 3)]);
+      for (BB bb = to_squares & check_mask; bb; resetLSB(bb)) {
+        Square to = lsb(bb);
+        for (BB bb_from = board->attackers(to, side_to_move) & movers; bb_from; resetLSB(bb_from)) {
+          Square from = lsb(bb_from);
+          addMove(board->getPiece(from), from, to, board->getPiece(to) == NoPiece ? QUIET : CAPTURE);
+        }
+      }
+    }
+    addMoves(King, king_square, safeKingSquares(king_square, kingAttacks(king_square) & to_squares));
+  }
+
   __forceinline void addMoves(const Piece piece, const Square from, const BB& attacks) {
     for (BB bb = attacks; bb; resetLSB(bb)) {
       Square to = lsb(bb);
@@ -284,9 +320,14 @@ private:
   }
 
   __forceinline void addPawnMoves(const BB& to_squares, const int* dist, const Move type) {
-    for (BB bb = to_squares; bb; resetLSB(bb)) {
+    // An en passant capture can remove a checking pawn without landing on the
+    // check mask, so these are tested in addMove instead.
+    for (BB bb = (type & EPCAPTURE) ? to_squares : to_squares & check_mask; bb; resetLSB(bb)) {
       Square to = lsb(bb);
       Square from = to - dist[side_to_move];
+      if ((pinMask(from) & bbSquare(to)) == 0) {
+        continue;
+      }
       if (rankOf(to) == 0 || rankOf(to) == 7) {
         if (flags & QUEENPROMOTION) {
           addMove(Pawn | (side_to_move << 3), from, to, type | PROMOTION, Queen | (side_to_move << 3));
@@ -317,16 +358,61 @@ private:
     return false;
   }
 
-  __forceinline bool isLegal(const Move m, const Piece piece, const Square from, Move type) {
-    if ((pinned & bbSquare(from)) || in_check || (piece & 7) == King || (type & EPCAPTURE)) {
-      board->makeMove(m);
-      if (board->isAttacked(board->king_square[side_to_move], side_to_move ^ 1)) {
-        board->unmakeMove(m);
-        return false;
+  // The check mask is set up by reset for every generation, the pins only
+  // when generating legal moves. With a single checker the other pieces must
+  // capture it or block, with two only the king can move.
+  __forceinline BB checkMask() const {
+    if (checkers == 0) {
+      return ~(BB)0;
+    }
+    if (checkers & (checkers - 1)) {
+      return 0;
+    }
+    return checkers | bb_between[lsb(checkers)][king_square];
+  }
+
+  // A pinned piece stays on the line through its king and the pinner.
+  __forceinline BB pinMask(const Square from) const {
+    return (pinned & bbSquare(from)) ? bb_line[king_square][from] : ~(BB)0;
+  }
+
+  // The king must not step onto an attacked square, and sliders checking it
+  // also attack the squares behind it.
+  __forceinline BB safeKingSquares(const Square from, BB to_squares) const {
+    BB safe = 0;
+    for (BB bb = to_squares; bb; resetLSB(bb)) {
+      if (!board->isAttacked(lsb(bb), side_to_move ^ 1, occupied ^ bbSquare(from))) {
+        safe |= bbSquare(lsb(bb));
       }
-      board->unmakeMove(m);
     }
-    return true;
+    return safe;
+  }
+
+  // Legality of a pseudo legal move that is not generated here.
+  __forceinline bool isLegal(const Move m) {
+    const Square from = moveFrom(m);
+    const Square to = moveTo(m);
+
+    if (isCastleMove(m)) {
+      // isPseudoLegal has already checked the squares the king passes.
+      return true;
+    }
+    if ((movePiece(m) & 7) == King) {
+      return safeKingSquares(from, bbSquare(to)) != 0;
+    }
+    if (isEpCapture(m)) {
+      return isLegalEpCapture(m);
+    }
+    return (check_mask & pinMask(from) & bbSquare(to)) != 0;
+  }
+
+  // En passant captures remove two pieces from the line of the king, so they
+  // are tested by making the move.
+  __forceinline bool isLegalEpCapture(const Move m) {
+    board->makeMove(m);
+    bool legal = !board->isAttacked(board->king_square[side_to_move], side_to_move ^ 1);
+    board->unmakeMove(m);
+    return legal;
   }
 
   __forceinline bool canCastleShort() {
@@ -387,7 +473,10 @@ private:
   int stage;
   int max_stage;
   int number_moves;
+  Square king_square;
   BB pinned;
+  BB checkers;
+  BB check_mask;
   MoveSorter* sorter;
   Move transp_move;
   int flags;
@@ -0,0 +1,234 @@
+/*
+  This file is part of Bobcat.
+  Copyright 2008-2015 Gunnar Harms
+
+  Bobcat is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Bobcat is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Bobcat.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Hardware performance counters of the calling thread, read with
+// perf_event_open on Linux. Each counter is opened on its own so that the
+// ones the kernel or a container refuses are simply reported as missing.
+// Elsewhere no counter is available.
+class PerfCounters
+{
+public:
+  enum Counter {
+    CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, DTLB_MISSES, BRANCH_MISSES, NUM_COUNTERS
+  };
+
+  PerfCounters() : num_available(0), error(0)
+  {
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      fd[i] = -1;
+    }
+    clear();
+  }
+
+  ~PerfCounters()
+  {
+    close();
+  }
+
+  // Returns the number of counters that could be opened.
+  int open()
+  {
+    close();
+#if defined(__linux__)
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = TYPES[i];
+      attr.config = CONFIGS[i];
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fd[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+      if (fd[i] == -1) {
+        error = errno;
+      }
+      else {
+        num_available++;
+      }
+    }
+#endif
+    return num_available;
+  }
+
+  void close()
+  {
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      if (fd[i] != -1) {
+        ::close(fd[i]);
+        fd[i] = -1;
+      }
+    }
+    num_available = 0;
+  }
+
+  void clear()
+  {
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      values[i] = 0;
+    }
+  }
+
+  __forceinline void start()
+  {
+#if defined(__linux__)
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      if (fd[i] != -1) {
+        ioctl(fd[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd[i], PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+#endif
+  }
+
+  // Adds the counts since start() to the totals. Counts are scaled up when
+  // the kernel had to multiplex the counters.
+  __forceinline void stop()
+  {
+#if defined(__linux__)
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      if (fd[i] != -1) {
+        ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+      }
+    }
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      uint64_t data[3];
+      if (fd[i] != -1 && read(fd[i], data, sizeof(data)) == sizeof(data) && data[2]) {
+        values[i] += data[2] < data[1] ? (uint64_t)((double)data[0]*data[1]/data[2]) : data[0];
+      }
+    }
+#endif
+  }
+
+  bool isAvailable(int counter) const
+  {
+    return fd[counter] != -1;
+  }
+
+  int numAvailable() const
+  {
+    return num_available;
+  }
+
+  uint64_t value(int counter) const
+  {
+    return values[counter];
+  }
+
+  const uint64_t* totals() const
+  {
+    return values;
+  }
+
+  // Prints counts per unit, one counter per line.
+  void print(const uint64_t* counts, uint64_t units, const char* unit) const
+  {
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      char label[64];
+      snprintf(label, sizeof(label), "%s/%s", name(i), unit);
+      if (isAvailable(i)) {
+        printf("%-20s: %.2f\n", label, perUnit(counts[i], units));
+      }
+      else {
+        printf("%-20s: n/a\n", label);
+      }
+    }
+  }
+
+  // Prints counts per unit as one table row, see printHeader.
+  void printRow(const uint64_t* counts, uint64_t units) const
+  {
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      if (isAvailable(i)) {
+        printf(" %13.2f", perUnit(counts[i], units));
+      }
+      else {
+        printf(" %13s", "n/a");
+      }
+    }
+  }
+
+  static void printHeader()
+  {
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      printf(" %13s", name(i));
+    }
+  }
+
+  // Prints counts per unit as a JSON object with null for missing counters.
+  void printJson(const uint64_t* counts, uint64_t units) const
+  {
+    printf("{");
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      printf("%s\"%s\": ", i ? ", " : "", name(i));
+      if (isAvailable(i)) {
+        printf("%.2f", perUnit(counts[i], units));
+      }
+      else {
+        printf("null");
+      }
+    }
+    printf("}");
+  }
+
+  const char* errorString() const
+  {
+    return error ? strerror(error) : "not supported on this platform";
+  }
+
+  static const char* name(int counter)
+  {
+    static const char* names[NUM_COUNTERS] = {
+      "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses"
+    };
+    return names[counter];
+  }
+
+private:
+  static double perUnit(uint64_t count, uint64_t units)
+  {
+    return units ? (double)count/units : 0;
+  }
+
+#if defined(__linux__)
+  static const uint32_t TYPES[NUM_COUNTERS];
+  static const uint64_t CONFIGS[NUM_COUNTERS];
+#endif
+
+  int fd[NUM_COUNTERS];
+  uint64_t values[NUM_COUNTERS];
+  int num_available;
+  int error;
+};
+
+#if defined(__linux__)
+const uint32_t PerfCounters::TYPES[NUM_COUNTERS] = {
+  PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+  PERF_TYPE_HARDWARE
+};
+
+const uint64_t PerfCounters::CONFIGS[NUM_COUNTERS] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+  PERF_COUNT_HW_CACHE_MISSES,
+  PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+  PERF_COUNT_HW_BRANCH_MISSES
+};
+#endif
@@ -1,11 +1,19 @@
 #include <fcntl.h>
+#if defined(_WIN32)
 #include <io.h>
+#else
+#include <unistd.h>
+#endif
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
 #include <time.h>
 #include <stdio.h>
 
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
 namespace pgn {
 
 class File {
@@ -54,12 +62,12 @@ public:
   UnexpectedToken(Token expected, const char* found, size_t line)
   {
     sprintf(buf, "Expected <%s> but found '%s', line=%llu",
-            token_string[expected], found, line);
+            token_string[expected], found, (unsigned long long)line);
   }
 
   UnexpectedToken(const char* expected, const char* found, size_t line)
   {
-    sprintf(buf, "Expected %s but found '%s', line=%llu", expected, found, line);
+    sprintf(buf, "Expected %s but found '%s', line=%llu", expected, found, (unsigned long long)line);
   }
 
   const char* str() const
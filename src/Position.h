@@ -31,7 +31,7 @@ public:
     material.clear();
     last_move = 0;
     null_moves_in_row = 0;
-    transposition = 0;
+    transposition = false;
     last_move = 0;
   }
 
@@ -122,5 +122,5 @@ public:
   int transp_type;
   Move transp_move;
   int flags;
-  Transposition* transposition;
+  bool transposition;
 };
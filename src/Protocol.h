@@ -15,11 +15,13 @@
   You should have received a copy of the GNU General Public License
   along with Bobcat.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <atomic>
 
 const int FIXED_MOVE_TIME = 1;
 const int FIXED_DEPTH = 2;
 const int INFINITE_MOVE_TIME = 4;
 const int PONDER_SEARCH = 8;
+const int FIXED_NODES = 16;
 
 class ProtocolListener {
 public:
@@ -38,6 +40,8 @@ public:
     this->game = game;
     this->input = input;
     this->output = output;
+    this->flags = 0;
+    this->num_search_moves = 0;
   }
 
   virtual ~Protocol() {
@@ -52,8 +56,10 @@ public:
 
   virtual void postInfo(const Move curr_move, int curr_move_number) = 0;
 
+  virtual void postInfoString(const char* info) = 0;
+
   virtual void postPV(const int depth, int max_ply, uint64_t node_count, uint64_t nodes_per_second, uint64_t time,
-                      int hash_full, int score, const char* pv, int node_type) = 0;
+                      int hash_full, int score, const char* pv, int node_type, int multipv) = 0;
 
   __forceinline int isAnalysing() {
     return flags & (INFINITE_MOVE_TIME | PONDER_SEARCH);
@@ -71,13 +77,38 @@ public:
     return depth;
   }
 
+  __forceinline int isFixedNodes() {
+    return flags & FIXED_NODES;
+  }
+
+  __forceinline uint64_t getNodes() {
+    return nodes;
+  }
+
+  // The root moves given with searchmoves, none if all moves are searched.
+  __forceinline const Move* getSearchMoves() {
+    return search_moves;
+  }
+
+  __forceinline int getNumSearchMoves() {
+    return num_search_moves;
+  }
+
+  // True when the search is limited by the clock.
+  __forceinline bool isTimed() {
+    return !isAnalysing() && !isFixedDepth() && !isFixedNodes();
+  }
+
   __forceinline void setFlags(int flags) {
     this->flags = flags;
   }
 
 protected:
-  int flags;
+  std::atomic<int> flags;
   int depth;
+  uint64_t nodes;
+  Move search_moves[256];
+  int num_search_moves;
   ProtocolListener* callback;
   StdIn* input;
   StdOut* output;
@@ -91,10 +122,14 @@ public:
   {
   }
 
+  // Called by the supervisor while searching and by postMoves while waiting.
   virtual void checkInput() {
     char line[16384];
     input->getLine(false, line);
-    if (strieq(trim(line), "stop")) {
+    if (strieq(trim(line), "isready")) {
+      output->writeLine("readyok");
+    }
+    else if (strieq(trim(line), "stop")) {
       flags &= ~(INFINITE_MOVE_TIME | PONDER_SEARCH);
       callback->stop();
     }
@@ -102,12 +137,16 @@ public:
       flags &= ~(INFINITE_MOVE_TIME | PONDER_SEARCH);
       callback->ponderHit();
     }
+    else if (strlen(line)) {
+      input->putBack(line);
+    }
   }
 
   void postMoves(const char* bestmove, const char* pondermove) {
     while (flags & (INFINITE_MOVE_TIME | PONDER_SEARCH)) {
-      Sleep(10);
-      checkInput();
+      if (input->waitForInput(-1)) {
+        checkInput();
+      }
     }
     char buf[128];
     snprintf(buf, sizeof(buf), "bestmove %s", bestmove);
@@ -121,7 +160,7 @@ public:
                         uint64_t time, int hash_full)
   {
     char buf[1024];
-    _snprintf(buf, sizeof(buf),
+    snprintf(buf, sizeof(buf),
               "info depth %d " \
               "seldepth %d " \
               "hashfull %d " \
@@ -151,11 +190,25 @@ public:
     output->writeLine(buf);
   }
 
+  virtual void postInfoString(const char* info) {
+    char buf[1024];
+    snprintf(buf, sizeof(buf), "info string %s", info);
+    output->writeLine(buf);
+  }
+
   virtual void postPV(const int depth, int max_ply, uint64_t node_count, uint64_t nodes_per_second,
-                      uint64_t time, int hash_full, int score, const char* pv, int node_type)
+                      uint64_t time, int hash_full, int score, const char* pv, int node_type, int multipv)
   {
+    char line[24];
     char bound[24];
 
+    if (multipv) {
+      snprintf(line, sizeof(line), "multipv %d ", multipv);
+    }
+    else {
+      line[0] = 0;
+    }
+
     if (node_type == 4) {
       strcpy(bound, "upperbound ");
     }
@@ -167,8 +220,9 @@ public:
     }
     char buf[1024];
 
-    _snprintf(buf, sizeof(buf),
-              "info depth %d "
+    snprintf(buf, sizeof(buf),
+              "info %s"
+              "depth %d "
               "seldepth %d "
               "score cp %d "
               "%s"
@@ -177,6 +231,7 @@ public:
               "nps %" PRIu64 " "
               "time %" PRIu64 " "
               "pv %s",
+              line,
               depth,
               max_ply,
               score,
@@ -202,17 +257,22 @@ public:
                "option name Hash type spin default 1024 min 8 max 65536\n" \
                "option name Ponder type check default true\n" \
                "option name Threads type spin default 1 min 1 max 64\n" \
+               "option name Move Overhead type spin default 50 min 0 max 5000\n" \
+               "option name BindThreads type check default false\n" \
+               "option name ABDADA type check default false\n" \
+               "option name Deterministic type check default false\n" \
+               "option name MultiPV type spin default 1 min 1 max 32\n" \
                "option name UCI_Chess960 type check default false\n" \
                "uciok");
 
       output->writeLine(buf);
     }
     else if (strieq(params[0], "isready")) {
-      printf("readyok\n");
+      output->writeLine("readyok");
     }
     else if (strieq(params[0], "ucinewgame")) {
       callback->newGame();
-      printf("readyok\n");
+      output->writeLine("readyok");
     }
     else if (strieq(params[0], "position")) {
       handlePosition(params, num_params);
@@ -238,6 +298,7 @@ public:
     int movestogo = 0;
 
     flags = 0;
+    num_search_moves = 0;
     for (int param = 1; param < num_params; param++) {
       if (strieq(params[param], "movetime")) {
         flags |= FIXED_MOVE_TIME;
@@ -251,6 +312,12 @@ public:
           depth = strtol(params[param], NULL, 10);
         }
       }
+      else if (strieq(params[param], "nodes")) {
+        flags |= FIXED_NODES;
+        if (++param < num_params) {
+          nodes = strtoull(params[param], NULL, 10);
+        }
+      }
       else if (strieq(params[param], "wtime")) {
         if (++param < num_params) {
           wtime = strtol(params[param], NULL, 10);
@@ -282,6 +349,17 @@ public:
       else if (strieq(params[param], "ponder")) {
         flags |= PONDER_SEARCH;
       }
+      else if (strieq(params[param], "searchmoves")) {
+        while (param + 1 < num_params && num_search_moves < 256) {
+          const Move* move = game->pos->stringToMove(params[param + 1]);
+
+          if (move == NULL) {
+            break;
+          }
+          search_moves[num_search_moves++] = *move;
+          param++;
+        }
+      }
     }
     callback->go(wtime, btime, movestogo, winc, binc, movetime);
     return 0;
@@ -321,9 +399,9 @@ public:
 
   bool handleSetOption(const char* params[], int num_params) {
     int param = 1;
-    const char* option_name;
+    char option_name[256];
     const char* option_value;
-    if (parseOptionName(param, params, num_params, &option_name) &&
+    if (parseOptionName(param, params, num_params, option_name, sizeof(option_name)) &&
         parseOptionValue(param, params, num_params, &option_value))
     {
       return callback->setOption(option_name, option_value) == 0;
@@ -331,17 +409,21 @@ public:
     return false;
   }
 
-  bool parseOptionName(int& param, const char* params[], int num_params, const char** option_name) {
+  // Option names can have spaces, so take every token up to "value".
+  bool parseOptionName(int& param, const char* params[], int num_params, char* option_name, size_t size) {
     while (param < num_params) {
       if (strieq(params[param++], "name")) {
         break;
       }
     }
-    if (param < num_params) {
-      *option_name = params[param++];
-      return *option_name != '\0';
+    option_name[0] = '\0';
+    while (param < num_params && !strieq(params[param], "value")) {
+      if (option_name[0]) {
+        strncat(option_name, " ", size - strlen(option_name) - 1);
+      }
+      strncat(option_name, params[param++], size - strlen(option_name) - 1);
     }
-    return false;
+    return option_name[0] != '\0';
   }
 
   bool parseOptionValue(int& param, const char* params[], int num_params, const char** option_value) {
@@ -15,86 +15,314 @@
   You should have received a copy of the GNU General Public License
   along with Bobcat.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <atomic>
+
+// The node counts of all search threads, each on its own cache line so that
+// publishing a count never touches a line another thread writes to. Reported
+// nodes and the node limit both use the sum. Threads compare the sum with the
+// limit every batch nodes, so a single thread stops exactly at the limit and
+// several threads within a batch each. The limit and the batch size are read
+// once per search, and the counters start on the line after them.
+class NodeCounters
+{
+public:
+  static void* operator new(size_t size)
+  {
+    void* mem = allocateAligned(size, alignof(NodeCounters));
+
+    if (mem == NULL) {
+      throw std::bad_alloc();
+    }
+    return mem;
+  }
+
+  static void operator delete(void* mem)
+  {
+    freeAligned(mem);
+  }
+
+  void reset(int num_threads, uint64_t limit, uint64_t batch)
+  {
+    this->num_threads = num_threads;
+    this->limit = limit;
+    this->batch = batch;
+
+    for (int i = 0; i < MAX_THREADS; i++) {
+      counters[i].nodes.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  std::atomic<uint64_t>& counter(int thread_id)
+  {
+    return counters[thread_id].nodes;
+  }
+
+  uint64_t sum() const
+  {
+    uint64_t nodes = 0;
+    for (int i = 0; i < num_threads; i++) {
+      nodes += counters[i].nodes.load(std::memory_order_relaxed);
+    }
+    return nodes;
+  }
+
+  uint64_t limit;
+  uint64_t batch;
+
+private:
+  static const int MAX_THREADS = 64;
+
+  struct alignas(64) Counter
+  {
+    std::atomic<uint64_t> nodes;
+  };
+
+  Counter counters[MAX_THREADS];
+  int num_threads;
+};
+
 typedef int Depth;
 typedef int Score;
 
 class Search : public MoveSorter
 {
 public:
+  struct PVEntry
+  {
+    uint64_t key;
+    Depth depth;
+    Score score;
+    Move move;
+    int node_type;
+    int eval;
+  };
+
+  struct RootLine
+  {
+    PVEntry pv[128];
+    int length;
+    Score score;
+  };
+
   Search(Protocol* protocol, Game* game, Eval* eval, See* see, TranspositionTable* transt, Logger* logger)
   {
     initialise(protocol, game, eval, see, transt, logger);
   }
 
-  Search(Game* game, Eval* eval, See* see, TranspositionTable* transt)
+  Search(Game* game, Eval* eval, See* see, TranspositionTable* transt, int thread_id)
   {
     initialise(0, game, eval, see, transt, 0);
-    stop_search = false;
+    this->thread_id = thread_id;
   }
 
   virtual ~Search() {
   }
 
-  int go(int wtime, int btime, int movestogo, int winc, int binc, int movetime, int num_workers)
+  int go(int wtime, int btime, int movestogo, int winc, int binc, int movetime)
   {
-    num_workers_ = num_workers;
     initialiseSearch(wtime, btime, movestogo, winc, binc, movetime);
+    return iterate();
+  }
 
+  // Runs the iterative deepening loop of a search set up by initialiseSearch.
+  int iterate()
+  {
     drawScore_[pos->side_to_move] = 0;//-25;
     drawScore_[!pos->side_to_move] = 0;//25;
 
-    auto alpha = -MAXSCORE;
-    auto beta = MAXSCORE;
+    while (search_depth < MAXDEPTH) {
+      search_depth++;
 
-    while (!stop_search && search_depth < MAXDEPTH) {
-      try {
-        search_depth++;
+      if (skipIteration()) {
+        continue;
+      }
 
-        do {
-          pv_length[0] = 0;
+      best_move_changes = 0;
+      STATS(stats.startIteration(node_count));
 
-          getTranspositionAndEvaluate(alpha, beta);
+      searchRoot();
 
-          auto score = search(true, search_depth, alpha, beta, EXACT);
+      if (isStopped()) {
+        // A stop keeps the best line found so far in the iteration.
+        if (num_found_lines > 0) {
+          takeLine(0);
+        }
+        if (pv_length[0]) {
+          storePV();
+        }
+        break;
+      }
 
-          if (score > alpha && score < beta) {
-            break;
-          }
-          checkTime();
+      if (num_lines > 1) {
+        takeLine(0);
+        postLines();
+      }
+      storePV();
+      storeCompletedIteration();
+      STATS(stats.endIteration(search_depth, node_count));
+
+      if (moveIsEasy()) {
+        break;
+      }
+    }
+    return 0;
+  }
+
+  // Runs the aspiration loop around the score of the previous iteration. With
+  // more lines the root collects the best lines itself in a single pass, see
+  // insertLine, and the window only bounds the last line from below.
+  void searchRoot()
+  {
+    auto alpha = -MAXSCORE;
+    auto beta = MAXSCORE;
+
+    if (completed_depth > 0) {
+      alpha = std::max(-MAXSCORE, lines[num_lines - 1].score - 20);
+      beta = num_lines == 1 ? std::min(MAXSCORE, lines[0].score + 20) : MAXSCORE;
+    }
+
+    do {
+      pv_length[0] = 0;
+      num_found_lines = 0;
+      root_search_nodes = node_count;
+      getTranspositionAndEvaluate(alpha, beta);
 
-          alpha = std::max(-MAXSCORE, score - 100);
-          beta = std::min(MAXSCORE, score + 100);
-        } while (true);
+      auto score = search(true, search_depth, alpha, beta, EXACT);
 
-        storePV();
+      if (isStopped()) {
+        break;
+      }
 
-        if (moveIsEasy()) {
+      if (num_lines > 1) {
+        if (num_found_lines == num_lines || alpha == -MAXSCORE) {
           break;
         }
-        alpha = std::max(-MAXSCORE, pv[0][0].score - 20);
-        beta = std::min(MAXSCORE, pv[0][0].score + 20);
+        alpha = -MAXSCORE;
+        continue;
       }
-      catch (const int) {
-        while (ply) {
-          unmakeMove();
-        }
 
-        if (pv_length[0]) {
-          storePV();
-        }
+      if (score > alpha && score < beta) {
+        break;
       }
+      alpha = std::max(-MAXSCORE, score - 100);
+      beta = std::min(MAXSCORE, score + 100);
+    } while (true);
+
+    if (num_lines == 1 && !isStopped()) {
+      lines[0].score = pv[0][0].score;
     }
-    return 0;
+  }
+
+  // Puts the root line in pv[0] in its place among the best lines of the
+  // iteration. Once all lines are found the remaining root moves are searched
+  // with a null window at the score of the last line, and only searched again
+  // with an open window when they fail high.
+  void insertLine(uint64_t nodes)
+  {
+    const auto move = pv[0][0].move;
+    const auto score = pv[0][0].score;
+    const auto previous_best = lines[0].length ? lines[0].pv[0].move : 0;
+    auto i = std::min(num_found_lines, num_lines - 1);
+
+    for (; i > 0 && lines[i - 1].score < score; --i) {
+      lines[i] = lines[i - 1];
+    }
+
+    if (i == 0) {
+      best_move_changes += previous_best && previous_best != move;
+      best_move_nodes = nodes;
+    }
+    auto& line = lines[i];
+
+    line.length = pv_length[0];
+    line.score = score;
+    memcpy(line.pv, pv[0], line.length*sizeof(PVEntry));
+
+    num_found_lines = std::min(num_found_lines + 1, num_lines);
+  }
+
+  __forceinline void takeLine(int i)
+  {
+    pv_length[0] = lines[i].length;
+    memcpy(pv[0], lines[i].pv, pv_length[0]*sizeof(PVEntry));
+    game->pos->pv_length = pv_length[0];
+  }
+
+  void postLines()
+  {
+    for (auto i = 0; i < num_found_lines; ++i) {
+      postPV(lines[i].pv, lines[i].length, search_depth, max_ply, lines[i].score, EXACT, i + 1);
+    }
+  }
+
+  __forceinline bool isMultiRoot() const
+  {
+    return ply == 0 && num_lines > 1;
+  }
+
+  // Returns the index of the line the root move led in the previous
+  // iteration, or -1.
+  __forceinline int previousLine(const Move m) const
+  {
+    for (auto i = 0; i < num_lines; ++i) {
+      if (lines[i].pv[0].move == m) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  __forceinline bool isSearchMove(const Move m) const
+  {
+    return num_search_moves == 0 || std::find(search_moves, search_moves + num_search_moves, m)
+                                    != search_moves + num_search_moves;
+  }
+
+  int countRootMoves()
+  {
+    auto count = 0;
+
+    pos->generateMoves(0, 0, LEGALMOVES);
+
+    while (const auto move_data = pos->nextMove()) {
+      if (isSearchMove(move_data->move)) {
+        ++count;
+      }
+    }
+    return count;
+  }
+
+public:
+  void setMultiPV(int multipv)
+  {
+    this->multipv = std::max(1, std::min(MAX_LINES, multipv));
+  }
+
+  void setSearchMoves(const Move* moves, int count)
+  {
+    num_search_moves = count;
+    memcpy(search_moves, moves, count*sizeof(Move));
   }
 
   void stop()
   {
-    stop_search = true;
+    stop_search.store(true, std::memory_order_relaxed);
+  }
+
+  void setSearchingTable(SearchingTable* searching)
+  {
+    this->searching = searching;
+  }
+
+  void setNodeCounters(NodeCounters* node_counters)
+  {
+    this->node_counters = node_counters;
+    published_nodes = node_counters ? &node_counters->counter(thread_id) : &unpublished_nodes;
   }
 
   virtual void run()
   {
-    go(0, 0, 0, 0, 0, 0, 0);
+    go(0, 0, 0, 0, 0, 0);
   }
 
 protected:
@@ -108,12 +336,25 @@ protected:
     this->logger = logger;
     board = game->pos->board;
     verbosity = 1;
-    lag_buffer = -1;
+    thread_id = 0;
+    searching = 0;
+    setNodeCounters(0);
+    multipv = 1;
+    num_search_moves = 0;
+    stop_search = false;
   }
 
+  // Once the stop flag is raised every level returns STOPSCORE as soon as it
+  // notices, without storing anything, until the search is back at the root.
   Score search(bool pv, const Depth depth, Score alpha, const Score beta, int expectedNodeType)
   {
+    if (isStopped()) {
+      return STOPSCORE;
+    }
+    STATS(stats.main_nodes++);
+
     if (!pv && isTranspositionScoreValid(depth, alpha, beta)) {
+      STATS(stats.tt_cutoffs++);
       return searchNodeScore(pos->transp_score);
     }
 
@@ -126,14 +367,21 @@ protected:
         auto score = pos->eval_score - 50 - 100*(depth/2);
 
         if (score >= beta) {
+          STATS(stats.static_null_prunes++);
           return score;
         }
       }
+      STATS(stats.null_moves++);
       makeMoveAndEvaluate(0, alpha, beta);
       auto score = searchNextDepth(false, depth - nullMoveReduction(depth), -beta, -beta + 1, ALPHA);
       unmakeMove();
 
+      if (isStopped()) {
+        return STOPSCORE;
+      }
+
       if (score >= beta) {
+        STATS(stats.null_move_cutoffs++);
         return searchNodeScore(score);
       }
     }
@@ -141,31 +389,51 @@ protected:
     if (!pv && depth <= 3
         && pos->eval_score + razor_margin[depth] < beta)
     {
+      STATS(stats.razor_tries++);
       auto score = searchQuiesce(beta - 1, beta, 0, false);
 
+      if (isStopped()) {
+        return STOPSCORE;
+      }
+
       if (score < beta) {
+        STATS(stats.razor_prunes++);
         return searchNodeScore(std::max(score, pos->eval_score + razor_margin[depth]));
       }
     }
     Move singular_move = getSingularMove(depth, pv);
 
-    pos->generateMoves(this, pos->transp_move, STAGES);
+    if (isStopped()) {
+      return STOPSCORE;
+    }
+
+    // The root with more lines is not staged, so that sortMove can put all the
+    // lines of the previous iteration first.
+    pos->generateMoves(this, pos->transp_move, isMultiRoot() ? LEGALMOVES : STAGES|LEGALMOVES);
 
     auto best_move = 0;
     auto best_score = -MAXSCORE;
     auto move_count = 0;
+    const auto key = pos->key;
+    MoveData deferred_moves[MAX_DEFERRED_MOVES];
+    auto num_deferred = 0;
+    auto deferred_index = 0;
 
-    while (const auto move_data = pos->nextMove()) {
+    while (const auto move_data = nextSearchMove(depth, move_count, deferred_moves, num_deferred, deferred_index)) {
+      if (ply == 0 && root_filter && !isSearchMove(move_data->move)) {
+        continue;
+      }
+      const auto nodes_before = node_count;
       Score score;
 
       if (makeMoveAndEvaluate(move_data->move, alpha, beta)) {
         ++move_count;
 
-        if (protocol && ply == 1 && search_depth >= 20 && (search_time > 5000 || isAnalysing())) {
+        if (protocol && ply == 1 && search_depth >= 20 && (time_manager.getHardLimit() > 5000 || isAnalysing())) {
           protocol->postInfo(move_data->move, move_count);
         }
 
-        if (move_count == 1 && pv) {
+        if (pv && (move_count == 1 || (isMultiRoot() && num_found_lines < num_lines))) {
           score = searchNextDepth(true, nextDepthPV(singular_move, depth, move_data), -beta, -alpha, EXACT);
         }
         else {
@@ -173,28 +441,61 @@ protected:
           auto nextExpectedNodeType = (expectedNodeType & (EXACT|ALPHA)) ? BETA : ALPHA;
 
           if (next_depth == -999) {
+            STATS(stats.futility_prunes++);
             unmakeMove();
             continue;
           }
+          const auto marked = searching && depth >= ABDADA_DEPTH && searching->enter(key, move_data->move);
+          STATS(stats.lmr_reductions += next_depth < depth - 1);
+
           score = searchNextDepth(false, next_depth, -alpha - 1, -alpha, nextExpectedNodeType);
 
           if (score > alpha && depth > 1 && next_depth < depth - 1) {
+            STATS(stats.lmr_researches++);
             score = searchNextDepth(false, depth - 1, -alpha - 1, -alpha, nextExpectedNodeType);
           }
 
           if (score > alpha && score < beta) {
             score = searchNextDepth(true, nextDepthPV(0, depth, move_data), -beta, -alpha, EXACT);
           }
+
+          if (marked) {
+            searching->leave(key, move_data->move);
+          }
         }
         unmakeMove();
 
+        if (isStopped()) {
+          return STOPSCORE;
+        }
+
+        if (isMultiRoot()) {
+          if (score > alpha) {
+            updatePV(move_data->move, score, depth, EXACT);
+            insertLine(node_count - nodes_before);
+
+            if (num_found_lines == num_lines) {
+              alpha = lines[num_lines - 1].score;
+            }
+            best_move = lines[0].pv[0].move;
+            best_score = lines[0].score;
+          }
+          continue;
+        }
+
         if (score > best_score) {
           best_score = score;
 
           if (best_score > alpha) {
             best_move = move_data->move;
 
+            if (ply == 0) {
+              best_move_nodes = node_count - nodes_before;
+            }
+
             if (score >= beta) {
+              STATS(stats.fail_highs++);
+              STATS(stats.fail_highs_first += move_count == 1);
               if (ply == 0) {
                 updatePV(best_move, best_score, depth, BETA);
               }
@@ -226,6 +527,23 @@ protected:
     return storeSearchNodeScore(best_score, depth, nodeType(best_score, beta, best_move), best_move);
   }
 
+  // Returns the next move to search. In ABDADA mode moves after the first that
+  // another thread is searching right now are put aside and returned last.
+  __forceinline const MoveData* nextSearchMove(const Depth depth, const int move_count, MoveData* deferred_moves,
+                                               int& num_deferred, int& deferred_index)
+  {
+    while (const auto move_data = pos->nextMove()) {
+      if (searching && move_count > 0 && depth >= ABDADA_DEPTH && num_deferred < MAX_DEFERRED_MOVES
+          && searching->isSearching(pos->key, move_data->move))
+      {
+        deferred_moves[num_deferred++] = *move_data;
+        continue;
+      }
+      return move_data;
+    }
+    return deferred_index < num_deferred ? &deferred_moves[deferred_index++] : nullptr;
+  }
+
   __forceinline Score searchNextDepth(bool pv, const Depth depth, Score alpha, Score beta, int expectedNodeType)
   {
     if (pos->isDraw() || game->isRepetition()) {
@@ -239,7 +557,9 @@ protected:
   __forceinline Move getSingularMove(const Depth depth, bool pv)
   {
     if (pv && pos->transp_move && pos->transp_type == EXACT && depth >= 4) {
+      STATS(stats.singular_tries++);
       if (searchFailLow(depth/2, std::max(-MAXSCORE, pos->eval_score - 75), pos->transp_move)) {
+        STATS(stats.singular_extensions++);
         return pos->transp_move;
       }
     }
@@ -248,7 +568,7 @@ protected:
 
   bool searchFailLow(const Depth depth, Score alpha, const Move exclude_move)
   {
-    pos->generateMoves(this, pos->transp_move, STAGES);
+    pos->generateMoves(this, pos->transp_move, STAGES|LEGALMOVES);
 
     auto move_count = 0;
 
@@ -262,16 +582,23 @@ protected:
         Depth next_depth = nextDepthNotPV(true, depth, ++move_count, move_data, alpha, best_score, BETA);
 
         if (next_depth == -999) {
+          STATS(stats.futility_prunes++);
           unmakeMove();
           continue;
         }
+        STATS(stats.lmr_reductions += next_depth < depth - 1);
         auto score = searchNextDepth(false, next_depth, -alpha - 1, -alpha, BETA);
 
         if (score > alpha && depth > 1 && next_depth < depth - 1) {
+          STATS(stats.lmr_researches++);
           score = searchNextDepth(false, depth - 1, -alpha - 1, -alpha, BETA);
         }
         unmakeMove();
 
+        if (isStopped()) {
+          return false;
+        }
+
         if (score > alpha) {
           return false;
         }
@@ -355,7 +682,13 @@ protected:
 
   Score searchQuiesce(Score alpha, const Score beta, int qs_ply, bool search_pv)
   {
+    if (isStopped()) {
+      return STOPSCORE;
+    }
+    STATS(stats.quiesce_nodes++);
+
     if (!search_pv && isTranspositionScoreValid(0, alpha, beta)) {
+      STATS(stats.tt_cutoffs++);
       return searchNodeScore(pos->transp_score);
     }
 
@@ -402,6 +735,10 @@ protected:
         }
         unmakeMove();
 
+        if (isStopped()) {
+          return STOPSCORE;
+        }
+
         if (score > best_score) {
           best_score = score;
 
@@ -423,16 +760,19 @@ protected:
     return searchNodeScore(best_score);
   }
 
+  // Moves come from the legal move generator, so they need no legality test.
   __forceinline bool makeMoveAndEvaluate(const Move m, int alpha, int beta)
   {
-    if (game->makeMove(m, true, true)) {
+    if (game->makeMove(m, false, true)) {
       pos = game->pos;
       ++ply;
       pv_length[ply] = ply;
       ++node_count;
+      published_nodes->store(node_count, std::memory_order_relaxed);
 
-      checkSometimes();
-
+      if (node_limit && node_count - checked_nodes >= node_batch) {
+        checkNodeLimit();
+      }
       getTranspositionAndEvaluate(-beta, -alpha);
 
       max_ply = std::max(max_ply, ply);
@@ -448,27 +788,21 @@ protected:
     ply--;
   }
 
-  __forceinline void checkSometimes()
+  // Stops when all threads together reached the node limit. The master does
+  // not stop before its first iteration is complete, so that there is a move
+  // to play.
+  void checkNodeLimit()
   {
-    if ((node_count & 0x3fff) == 0) {
-      checkTime();
+    checked_nodes = node_count;
+
+    if (node_counters->sum() >= node_limit && (thread_id || completed_depth > 0)) {
+      stop();
     }
   }
 
-  __forceinline void checkTime()
+  __forceinline bool isStopped() const
   {
-    if (protocol) {
-      if (!isAnalysing() && !protocol->isFixedDepth()) {
-        stop_search = search_depth > 1 && start_time.millisElapsed() > (unsigned)search_time;
-      }
-      else {
-        protocol->checkInput();
-      }
-    }
-
-    if (stop_search) {
-      throw 1;
-    }
+    return stop_search.load(std::memory_order_relaxed);
   }
 
   __forceinline int isAnalysing() const
@@ -480,6 +814,9 @@ protected:
   {
     PVEntry* entry = &pv[ply][ply];
 
+    if (ply == 0 && num_lines == 1 && entry->move && entry->move != move) {
+      ++best_move_changes;
+    }
     entry->score = score;
     entry->depth = depth;
     entry->key = pos->key;
@@ -496,21 +833,60 @@ protected:
     if (ply == 0) {
       pos->pv_length = pv_length[0];
 
+      // With more lines they are all reported once the iteration is done.
+      if (num_lines == 1) {
+        postPV(pv[0], pv_length[0], search_depth, max_ply, score, node_type, 0);
+      }
+    }
+  }
+
+  void postPV(const PVEntry* line, int length, const Depth depth, const Depth seldepth, const Score score,
+              int node_type, int multipv)
+  {
+    if (protocol && verbosity > 0) {
       char buf[2048], buf2[16];
       buf[0] = 0;
 
-      for (auto i = ply; i < pv_length[ply]; ++i) {
+      for (auto i = 0; i < length; ++i) {
         snprintf(&buf[strlen(buf)], sizeof(buf) - strlen(buf), "%s ",
-                 game->moveToString(pv[ply][i].move, buf2));
-      }
-
-      if (protocol && verbosity > 0) {
-        protocol->postPV(search_depth, max_ply, node_count*num_workers_, nodesPerSecond(),
-                         std::max(1ull, start_time.millisElapsed()), transt->getLoad(), score, buf, node_type);
+                 game->moveToString(line[i].move, buf2));
       }
+      protocol->postPV(depth, seldepth, totalNodes(), nodesPerSecond(),
+                       std::max<uint64_t>(1, start_time.millisElapsed()), transt->getLoad(), score, buf, node_type,
+                       multipv);
     }
   }
 
+public:
+  // Replaces the line to play by the last completed line of another thread
+  // and reports it with that thread's depth, seldepth and score, so the last
+  // info line matches the bestmove.
+  void takeCompletedLine(const Search* other)
+  {
+    pv_length[0] = other->completed_pv_length;
+    memcpy(pv[0], other->completed_pv, pv_length[0]*sizeof(PVEntry));
+    game->pos->pv_length = pv_length[0];
+    postPV(pv[0], pv_length[0], other->completed_depth, other->completed_max_ply, pv[0][0].score, EXACT, 0);
+  }
+
+#if defined(SEARCH_STATS)
+  // Adds the statistics of the last search of this thread to total. Helpers
+  // skip iterations, so only the nodes per iteration of the master go into
+  // the branching factor.
+  void collectStats(SearchStats& total) const
+  {
+    total.add(stats, thread_id == 0);
+  }
+#endif
+
+  // Nodes searched by all threads in the last search.
+  uint64_t totalNodes() const
+  {
+    return node_counters ? node_counters->sum() : node_count;
+  }
+
+protected:
+
   __forceinline void storePV()
   {
     assert(pv_length[0] > 0);
@@ -520,10 +896,35 @@ protected:
     }
   }
 
+  __forceinline void storeCompletedIteration()
+  {
+    completed_depth = search_depth;
+    completed_max_ply = max_ply;
+    completed_pv_length = pv_length[0];
+    memcpy(completed_pv, pv[0], completed_pv_length*sizeof(PVEntry));
+  }
+
+  // Helper threads skip iterations, each thread on its own schedule, so that
+  // they do not search the same depths in lockstep with the master.
+  __forceinline bool skipIteration() const
+  {
+    if (thread_id == 0 || search_depth == 1) {
+      return false;
+    }
+    const auto i = (thread_id - 1) % 20;
+    return ((search_depth + skip_phase[i])/skip_size[i]) % 2 != 0;
+  }
+
+  // A small per thread bonus that gives each helper its own root move order.
+  __forceinline int rootMoveOffset(const Move m) const
+  {
+    return ((m ^ (thread_id*0x9e3779b9u))*2654435761u) >> 26;
+  }
+
   uint64_t nodesPerSecond() const
   {
     uint64_t micros = start_time.microsElapsedHighRes();
-    return micros == 0 ? node_count*num_workers_ : node_count*num_workers_*1000000/micros;
+    return micros == 0 ? totalNodes() : totalNodes()*1000000/micros;
   }
 
   __forceinline void updateHistoryScores(const Move move, const Depth depth)
@@ -563,40 +964,40 @@ protected:
     return score < 0 ? score - ply : score + ply;
   }
 
+public:
   void initialiseSearch(int wtime, int btime, int movestogo, int winc, int binc, int movetime)
   {
     pos = game->pos; // Updated in makeMove and unmakeMove from here on.
 
     if (protocol) {
-      if (protocol->isFixedTime()) {
-        search_time = 950*movetime/1000;
-      }
-      else {
-        int moves_left = movestogo > 30 ? 30 : movestogo;
-
-        if (moves_left == 0) {
-          moves_left = 30;
-        }
-        time_left = pos->side_to_move == 0 ? wtime : btime;
-        time_inc = pos->side_to_move == 0 ? winc : binc;
-
-        if (time_inc == 0 && time_left < 1000) {
-          search_time = time_left/(moves_left*2);
-          n_ = 1;
-        }
-        else {
-          search_time = 2*(time_left/(moves_left + 1) + time_inc);
-          n_ = 2.5;
-        }
-        search_time = std::max(0, std::min(search_time, time_left - 50));
-      }
+      time_manager.initialise(pos->side_to_move == 0 ? wtime : btime, pos->side_to_move == 0 ? winc : binc,
+                              movestogo, protocol->isFixedTime() ? movetime : 0);
       transt->initialiseSearch();
       stop_search = false;
       start_time.start();
     }
     ply = 0;
     search_depth = 0;
+    num_lines = 1;
+    num_found_lines = 0;
+    lines[0].length = 0;
+    root_filter = num_search_moves > 0;
+
+    if (multipv > 1 || root_filter) {
+      num_lines = std::max(1, std::min(multipv, countRootMoves()));
+    }
     node_count = 1;
+    published_nodes->store(node_count, std::memory_order_relaxed);
+    checked_nodes = 1;
+    node_limit = node_counters ? node_counters->limit : 0;
+    node_batch = node_counters ? node_counters->batch : 0;
+    completed_depth = 0;
+    completed_max_ply = 0;
+    completed_pv_length = 0;
+    best_move_changes = 0;
+    best_move_nodes = 0;
+    root_search_nodes = 0;
+    STATS(stats.clear());
     max_ply = 0;
     pos->pv_length = 0;
     memset(pv, 0, sizeof(pv));
@@ -605,10 +1006,21 @@ protected:
     memset(counter_moves, 0, sizeof(counter_moves));
   }
 
+protected:
+
   virtual void sortMove(MoveData& move_data)
   {
     const auto m = move_data.move;
 
+    if (isMultiRoot() && completed_depth > 0) {
+      const auto i = previousLine(m);
+
+      if (i >= 0) {
+        move_data.score = 890009 - i;
+        return;
+      }
+    }
+
     if (pos->transp_move == m) {
       move_data.score = 890010;
     }
@@ -650,6 +1062,10 @@ protected:
     else {
       move_data.score = history_scores[movePiece(m)][moveTo(m)];
     }
+
+    if (ply == 0 && thread_id && m != pos->transp_move) {
+      move_data.score += rootMoveOffset(m);
+    }
   }
 
   __forceinline Score searchNodeScore(const Score score) const
@@ -681,22 +1097,28 @@ protected:
     else if (node_type == EXACT) {
       pos->eval_score = score;
     }
-    pos->transposition = transt->insert(pos->key, depth, score, node_type, move, pos->eval_score);
+    transt->insert(pos->key, depth, score, node_type, move, pos->eval_score);
+    pos->transposition = true;
   }
 
   __forceinline void getTranspositionAndEvaluate(const Score alpha, const Score beta)
   {
-    if ((pos->transposition = transt->find(pos->key)) == 0) {
+    Transposition transp;
+
+    STATS(stats.tt_probes++);
+
+    if ((pos->transposition = transt->find(pos->key, transp)) == false) {
       pos->eval_score = eval->evaluate(alpha, beta);
       pos->transp_type = 0;
       pos->transp_move = 0;
       return;
     }
-    pos->transp_score = codecTTableScore(pos->transposition->score, -ply);
-    pos->eval_score = codecTTableScore(pos->transposition->eval, -ply);
-    pos->transp_depth = pos->transposition->depth;
-    pos->transp_type = pos->transposition->flags & 7;
-    pos->transp_move = pos->transposition->move;
+    STATS(stats.tt_hits++);
+    pos->transp_score = codecTTableScore(transp.score, -ply);
+    pos->eval_score = codecTTableScore(transp.eval, -ply);
+    pos->transp_depth = transp.depth;
+    pos->transp_type = transp.flags & 7;
+    pos->transp_move = transp.move;
     pos->flags = 0;
   }
 
@@ -713,7 +1135,7 @@ protected:
     return move ? (score >= beta ? BETA : EXACT) : ALPHA;
   }
 
-  bool moveIsEasy() const
+  bool moveIsEasy()
   {
     if (protocol) {
       if ((pos->moveCount() == 1 && search_depth > 9)
@@ -723,45 +1145,52 @@ protected:
         return true;
       }
 
-      if (!isAnalysing() && !protocol->isFixedDepth() && search_time < start_time.millisElapsedHighRes()*n_) {
+      if (protocol->isTimed()
+          && time_manager.iterationDone(start_time.millisElapsedHighRes(), best_move_changes, pv[0][0].score,
+                                        bestMoveShare()))
+      {
         return true;
       }
     }
     return false;
   }
 
+  // Share of the nodes of the last root search that went into the best move.
+  double bestMoveShare() const
+  {
+    const auto nodes = node_count - root_search_nodes;
+    return nodes ? (double)best_move_nodes/nodes : 1;
+  }
+
   __forceinline bool isPassedPawnMove(const Move m) const
   {
     return movePieceType(m) == Pawn && board->isPawnPassed(moveTo(m), moveSide(m));
   }
 
 public:
-  struct PVEntry
-  {
-    uint64_t key;
-    Depth depth;
-    Score score;
-    Move move;
-    int node_type;
-    int eval;
-  };
-
-  double n_;
   Depth ply;
   Depth max_ply;
   PVEntry pv[128][128];
   int pv_length[128];
   Stopwatch start_time;
-  int search_time;
-  int time_left;
-  int time_inc;
-  int lag_buffer;
-  volatile bool stop_search;
+  TimeManager time_manager;
+  std::atomic<bool> stop_search;
   int verbosity;
+  uint64_t node_count;
+#if defined(SEARCH_STATS)
+  SearchStats stats;
+#endif
+  std::atomic<Depth> completed_depth;
+  PVEntry completed_pv[128];
+  int completed_pv_length;
+  Depth completed_max_ply;
   Protocol* protocol;
 
 protected:
   Depth search_depth;
+  int best_move_changes;
+  uint64_t best_move_nodes;
+  uint64_t root_search_nodes;
   Move killer_moves[4][128];
   int history_scores[16][64];
   Move counter_moves[16][64];
@@ -772,23 +1201,43 @@ protected:
   See* see;
   Position* pos;
   TTable* transt;
+  SearchingTable* searching;
+  NodeCounters* node_counters;
+  uint64_t node_limit;
+  uint64_t node_batch;
+  std::atomic<uint64_t>* published_nodes;
+  std::atomic<uint64_t> unpublished_nodes;
+  uint64_t checked_nodes;
+  int multipv;
+  int num_lines;
+  int num_found_lines;
+  bool root_filter;
+  RootLine lines[32];
+  Move search_moves[256];
+  int num_search_moves;
   Logger* logger;
 
-  uint64_t node_count;
-  uint64_t num_workers_;
+  int thread_id;
 
   static const int EXACT = 1;
   static const int BETA = 2;
   static const int ALPHA = 4;
 
   static const int MAXSCORE = 0x7fff;
+  static const int STOPSCORE = MAXSCORE + 1;
   static const int MAXDEPTH = 96;
 
+  static const int ABDADA_DEPTH = 3;
+  static const int MAX_DEFERRED_MOVES = 32;
+  static const int MAX_LINES = 32;
+
   static const int KILLERMOVESCORE = 124900;
   static const int PROMOTIONMOVESCORE = 50000;
 
   static int futility_margin[4];
   static int razor_margin[4];
+  static int skip_size[20];
+  static int skip_phase[20];
 };
 
 const int Search::EXACT;
@@ -798,3 +1247,7 @@ const int Search::MAXSCORE;
 
 int Search::futility_margin[4] = { 150, 150, 150, 400 };
 int Search::razor_margin[4] = { 0, 125, 125, 400 };
+int Search::skip_size[20] = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+int Search::skip_phase[20] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+
+const int Search::MAX_LINES;
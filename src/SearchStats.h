@@ -0,0 +1,117 @@
+/*
+  This file is part of Bobcat.
+  Copyright 2008-2015 Gunnar Harms
+
+  Bobcat is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Bobcat is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Bobcat.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Search statistics are compiled in with -DSEARCH_STATS. Otherwise STATS()
+// expands to nothing and the search carries no counters at all.
+#if defined(SEARCH_STATS)
+#define STATS(statement) statement
+#else
+#define STATS(statement)
+#endif
+
+struct SearchStats {
+  static const int MAX_ITERATIONS = 128;
+
+  uint64_t tt_probes;
+  uint64_t tt_hits;
+  uint64_t tt_cutoffs;
+  uint64_t fail_highs;
+  uint64_t fail_highs_first;
+  uint64_t static_null_prunes;
+  uint64_t null_moves;
+  uint64_t null_move_cutoffs;
+  uint64_t razor_tries;
+  uint64_t razor_prunes;
+  uint64_t futility_prunes;
+  uint64_t lmr_reductions;
+  uint64_t lmr_researches;
+  uint64_t singular_tries;
+  uint64_t singular_extensions;
+  uint64_t main_nodes;
+  uint64_t quiesce_nodes;
+  uint64_t iteration_nodes[MAX_ITERATIONS];
+  uint64_t iteration_start;
+
+  void clear()
+  {
+    memset(this, 0, sizeof(SearchStats));
+  }
+
+  // The nodes per iteration are only added when iterations is set.
+  void add(const SearchStats& other, bool iterations = true)
+  {
+    const uint64_t* from = (const uint64_t*)&other;
+    uint64_t* to = (uint64_t*)this;
+    const size_t size = iterations ? sizeof(SearchStats) : offsetof(SearchStats, iteration_nodes);
+    for (size_t i = 0; i < size/sizeof(uint64_t); i++) {
+      to[i] += from[i];
+    }
+  }
+
+  __forceinline void startIteration(uint64_t node_count)
+  {
+    iteration_start = node_count;
+  }
+
+  __forceinline void endIteration(int depth, uint64_t node_count)
+  {
+    iteration_nodes[std::min(depth, MAX_ITERATIONS - 1)] += node_count - iteration_start;
+  }
+
+  // Passes the statistics as lines of text to output.
+  template <typename Output>
+  void report(Output output) const
+  {
+    char buf[512];
+    snprintf(buf, sizeof(buf), "tt probes %" PRIu64 " hits %.1f%% cutoffs %.1f%%", tt_probes,
+             percent(tt_hits, tt_probes), percent(tt_cutoffs, tt_probes));
+    output(buf);
+    snprintf(buf, sizeof(buf), "fail highs %" PRIu64 " on first move %.1f%%", fail_highs,
+             percent(fail_highs_first, fail_highs));
+    output(buf);
+    snprintf(buf, sizeof(buf), "null move static prunes %" PRIu64 " tries %" PRIu64 " cutoffs %.1f%%",
+             static_null_prunes, null_moves, percent(null_move_cutoffs, null_moves));
+    output(buf);
+    snprintf(buf, sizeof(buf), "razoring tries %" PRIu64 " prunes %.1f%% futility prunes %" PRIu64, razor_tries,
+             percent(razor_prunes, razor_tries), futility_prunes);
+    output(buf);
+    snprintf(buf, sizeof(buf), "lmr reductions %" PRIu64 " re-searches %.1f%%", lmr_reductions,
+             percent(lmr_researches, lmr_reductions));
+    output(buf);
+    snprintf(buf, sizeof(buf), "singular tries %" PRIu64 " extensions %.1f%%", singular_tries,
+             percent(singular_extensions, singular_tries));
+    output(buf);
+    snprintf(buf, sizeof(buf), "nodes main %" PRIu64 " quiescence %" PRIu64 " (%.1f%%)", main_nodes, quiesce_nodes,
+             percent(quiesce_nodes, main_nodes + quiesce_nodes));
+    output(buf);
+    strcpy(buf, "ebf");
+    for (int i = 2; i < MAX_ITERATIONS; i++) {
+      if (iteration_nodes[i] && iteration_nodes[i - 1]) {
+        snprintf(&buf[strlen(buf)], sizeof(buf) - strlen(buf), " %d:%.2f", i,
+                 (double)iteration_nodes[i]/iteration_nodes[i - 1]);
+      }
+    }
+    output(buf);
+  }
+
+private:
+  static double percent(uint64_t part, uint64_t total)
+  {
+    return total ? 100.0*part/total : 0;
+  }
+};
@@ -0,0 +1,144 @@
+/*
+  This file is part of Bobcat.
+  Copyright 2008-2015 Gunnar Harms
+
+  Bobcat is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Bobcat is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Bobcat.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+// Runs beside the master search. It reads the input and watches the clock,
+// so the search threads only have to read their stop flag.
+class Supervisor {
+public:
+  Supervisor() : search_(NULL), protocol_(NULL), input_(NULL), thread_(NULL), active_(false), supervising_(false),
+    exit_(false)
+  {
+  }
+
+  ~Supervisor() {
+    exit();
+  }
+
+  // Creates the thread once, it waits between searches.
+  void initialise(Protocol* protocol, StdIn* input) {
+    if (thread_) {
+      return;
+    }
+    protocol_ = protocol;
+    input_ = input;
+    thread_ = new std::thread(&Supervisor::idleLoop, this);
+  }
+
+  void start(Search* search) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    search_ = search;
+    active_ = true;
+    supervising_ = true;
+    cond_.notify_one();
+  }
+
+  void stop() {
+    if (thread_ == NULL) {
+      return;
+    }
+    active_ = false;
+    input_->interruptWait();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return !supervising_; });
+  }
+
+  void exit() {
+    if (thread_ == NULL) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      exit_ = true;
+      cond_.notify_one();
+    }
+    thread_->join();
+    delete thread_;
+    thread_ = NULL;
+    exit_ = false;
+  }
+
+protected:
+  void idleLoop() {
+    // It would otherwise inherit the cpu of a bound master thread.
+    topology::unbindThread();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+      cond_.wait(lock, [this] { return supervising_ || exit_; });
+
+      if (exit_) {
+        return;
+      }
+      lock.unlock();
+      supervise();
+      lock.lock();
+      supervising_ = false;
+      cond_.notify_one();
+    }
+  }
+
+  void supervise() {
+    while (active_) {
+      if (input_->waitForInput(microsToNextCheck())) {
+        protocol_->checkInput();
+      }
+
+      if (isTimeUp()) {
+        search_->stop();
+      }
+    }
+  }
+
+  // Sleeps until the deadline or the next input. Past the deadline the first
+  // iteration is still running, so look again every POLL_MICROS.
+  int64_t microsToNextCheck() const {
+    if (!isTimed()) {
+      return -1;
+    }
+    int64_t remaining = search_->time_manager.getHardLimit()*1000LL - (int64_t)search_->start_time.microsElapsedHighRes();
+    return remaining > 0 ? remaining : POLL_MICROS;
+  }
+
+  // The first iteration is always completed so that there is a move to play.
+  bool isTimeUp() const {
+    return isTimed() && search_->completed_depth > 0
+           && search_->start_time.microsElapsedHighRes() >= search_->time_manager.getHardLimit()*1000ULL;
+  }
+
+  bool isTimed() const {
+    return protocol_->isTimed();
+  }
+
+  Search* search_;
+  Protocol* protocol_;
+  StdIn* input_;
+  std::thread* thread_;
+  std::atomic<bool> active_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool supervising_;
+  bool exit_;
+
+  static const int64_t POLL_MICROS = 1000;
+};
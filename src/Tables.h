@@ -15,121 +15,269 @@
   You should have received a copy of the GNU General Public License
   along with Bobcat.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <thread>
 
-#pragma pack(1)
 struct Transposition {
-  uint32_t key;
-  uint16_t age; // 7 bits left
+  uint16_t key;
+  uint8_t age;
   uint8_t depth;
-  uint8_t flags; // 5 bits left
+  uint8_t flags;
   int16_t score;
   Move move;
   int16_t eval;
 };
-#pragma pack()
+
+// A bucket fills exactly one cache line and holds 5 entries of 12 bytes: a
+// data word with move, score and eval, and a check word with key, depth, age
+// and bound. Entries are written without locking. The key bits of the check
+// word are xor'ed with the folded data word, so an entry combined from two
+// different writes fails the key check and is treated as a miss.
+struct TranspositionBucket {
+  uint64_t data[5];
+  uint32_t check[5];
+  uint32_t unused;
+};
 
 class TranspositionTable {
 public:
-  TranspositionTable(uint64_t size_mb) : table(NULL), size_mb(0) {
-    if (sizeof(Transposition) != 16) {
-      printf("error sizeof(Transposition) == %d\n", static_cast<int>(sizeof(Transposition)));
+  TranspositionTable(uint64_t size_mb) : table(NULL), size_mb(0), num_buckets(0), page_mode(PAGES_NORMAL),
+    needs_clear(false), used(false), num_clearing(0) {
+    if (sizeof(TranspositionBucket) != CACHE_LINE_SIZE) {
+      printf("error sizeof(TranspositionBucket) == %d\n", static_cast<int>(sizeof(TranspositionBucket)));
       exit(0);
     }
     initialise(size_mb);
   }
 
+  ~TranspositionTable() {
+    finishClearing();
+    freeLargePages(table, num_buckets*sizeof(TranspositionBucket));
+  }
+
+  // Only records the new size. The memory is allocated by the first search.
   void initialise(uint64_t new_size_mb) {
     new_size_mb = pow2(log2(new_size_mb));
     if (new_size_mb == size_mb) {
       return;
     }
+    finishClearing();
+    freeLargePages(table, num_buckets*sizeof(TranspositionBucket));
+    table = NULL;
     size_mb = new_size_mb;
-    size = 1024*1024*size_mb/sizeof(Transposition);
-    mask = size - 1;
-    size += NUMBER_SLOTS - 1;
-    delete [] table;
-    table = new Transposition[size];
+    num_buckets = 1024*1024*size_mb/sizeof(TranspositionBucket);
+    mask = num_buckets - 1;
+    size = num_buckets*NUMBER_SLOTS;
     clear();
   }
 
-  __forceinline void clear() {
-    memset(table, 0, size*sizeof(Transposition));
+  // Only marks the table for clearing, which is done by the next search or
+  // by prepareInBackground. A table no search has used since it was last
+  // cleared is left alone.
+  void clear() {
+    needs_clear = needs_clear || used;
     occupied = 0;
     age = 0;
   }
 
+  // Allocates the table when needed and starts clearing it on num_threads
+  // threads without waiting for them. The next prepareSearch waits. Returns
+  // true when the table was allocated.
+  bool prepareInBackground(int num_threads, bool bind) {
+    bool allocated = allocate();
+    startClearing(num_threads, bind);
+    return allocated;
+  }
+
+  // Allocates and clears the table when needed, or waits for the clearing
+  // started by prepareInBackground. Clearing is split over num_threads
+  // threads, which also spreads the first touch of the pages. With bind
+  // each of them runs on the cpu of the search thread with its index.
+  // Returns true when the table was allocated.
+  bool prepareSearch(int num_threads, bool bind) {
+    bool allocated = allocate();
+    startClearing(num_threads, bind);
+    finishClearing();
+    used = true;
+    return allocated;
+  }
+
   void initialiseSearch() {
     age++;
   }
 
-  __forceinline Transposition* find(const uint64_t key) {
-    Transposition* transp = table + (key & mask);
-    for (int i = 0; i < NUMBER_SLOTS; i++, transp++) {
-      if (transp->key == key32(key) && transp->flags) {
-        return transp;
+  __forceinline void prefetch(const uint64_t key) {
+    __builtin_prefetch(table + (key & mask));
+  }
+
+  __forceinline bool find(const uint64_t key, Transposition& transp) {
+    TranspositionBucket* bucket = table + (key & mask);
+    for (int i = 0; i < NUMBER_SLOTS; i++) {
+      uint64_t data = load(bucket->data[i]);
+      uint32_t meta = load(bucket->check[i]) ^ fold(data);
+      if (metaKey(meta) == key16(key) && metaFlags(meta)) {
+        unpack(meta, data, transp);
+        return true;
       }
     }
-    return 0;
+    return false;
   }
 
-  __forceinline Transposition* insert(const uint64_t key, const int depth, const int score,
-                                      const int type, const int move, int eval)
+  __forceinline void insert(const uint64_t key, const int depth, const int score,
+                            const int type, const int move, int eval)
   {
-    Transposition* transp = getEntryToReplace(key, depth);
-    if (transp->flags == 0) {
+    TranspositionBucket* bucket = table + (key & mask);
+    int i = getEntryToReplace(bucket, key);
+    uint64_t old_data = load(bucket->data[i]);
+    uint32_t old_meta = load(bucket->check[i]) ^ fold(old_data);
+    if (metaFlags(old_meta) == 0) {
       occupied++;
     }
-    transp->move = transp->key != key32(key) || move != 0 ? move : transp->move;
-    transp->key = key32(key);
-    transp->score = (int16_t)score;
-    transp->depth = (uint8_t)depth;
-    transp->flags = (uint8_t)type;
-    transp->age = (uint16_t)age;
-    transp->eval = (int16_t)eval;
-    return transp;
-  }
-
-  __forceinline Transposition* getEntryToReplace(uint64_t key, int depth) {
-    Transposition* transp = table + (key & mask);
-    if (transp->flags == 0 || transp->key == key32(key)) {
-      return transp;
+    Move new_move = metaKey(old_meta) != key16(key) || move != 0 ? move : (Move)(old_data >> 32);
+    uint64_t data = ((uint64_t)new_move << 32) | ((uint64_t)(uint16_t)score << 16) | (uint16_t)eval;
+    uint32_t meta = ((uint32_t)key16(key) << 16) | ((uint32_t)(uint8_t)depth << 8) | ((age & 31) << 3) | (type & 7);
+    store(bucket->data[i], data);
+    store(bucket->check[i], meta ^ fold(data));
+  }
+
+  __forceinline int getLoad() {
+    return (int)((double)occupied/size*1000);
+  }
+
+  int getSizeMb() {
+    return (int)size_mb;
+  }
+
+  const char* getPageMode() {
+    return pageModeString(page_mode);
+  }
+
+  __forceinline static uint16_t key16(const uint64_t key) {
+    return key >> 48;
+  }
+
+protected:
+  bool allocate() {
+    if (table) {
+      return false;
+    }
+    table = (TranspositionBucket*)allocateLargePages(num_buckets*sizeof(TranspositionBucket), page_mode);
+    if (table == NULL) {
+      printf("error allocating %d MB for the transposition table\n", static_cast<int>(size_mb));
+      exit(0);
+    }
+    topology::interleave(table, num_buckets*sizeof(TranspositionBucket));
+    needs_clear = true;
+    return true;
+  }
+
+  void startClearing(int num_threads, bool bind) {
+    if (!needs_clear || num_clearing) {
+      return;
+    }
+    num_clearing = std::max(1, std::min(64, num_threads));
+    uint64_t chunk = num_buckets/num_clearing;
+
+    for (int i = 0; i < num_clearing; i++) {
+      clearing[i] = new std::thread(&TranspositionTable::clearBuckets, this, i, bind, i*chunk,
+                                    i == num_clearing - 1 ? num_buckets : (i + 1)*chunk);
+    }
+    needs_clear = false;
+    used = false;
+  }
+
+  void finishClearing() {
+    for (int i = 0; i < num_clearing; i++) {
+      clearing[i]->join();
+      delete clearing[i];
+    }
+    num_clearing = 0;
+  }
+
+  // Threads started by a bound thread inherit its single cpu, so each
+  // clearing thread binds itself.
+  void clearBuckets(int thread_index, bool bind, uint64_t begin, uint64_t end) {
+    if (bind) {
+      topology::bindThread(thread_index);
     }
-    Transposition* replace = transp++;
-    int replace_score = (replace->age << 9) + replace->depth;
-    for (int i = 1; i < NUMBER_SLOTS; i++, transp++) {
-      if (transp->flags == 0 || transp->key == key32(key)) {
-        return transp;
+    memset(table + begin, 0, (end - begin)*sizeof(TranspositionBucket));
+  }
+
+  __forceinline int getEntryToReplace(TranspositionBucket* bucket, uint64_t key) {
+    int replace = 0;
+    int replace_score = 0;
+    for (int i = 0; i < NUMBER_SLOTS; i++) {
+      uint32_t meta = load(bucket->check[i]) ^ fold(load(bucket->data[i]));
+      if (metaFlags(meta) == 0 || metaKey(meta) == key16(key)) {
+        return i;
       }
-      int score = (transp->age << 9) + transp->depth;
-      if (score < replace_score) {
+      // Older entries go first, and among entries of the same age the shallowest.
+      int score = metaDepth(meta) - (((age - metaAge(meta)) & 31) << 8);
+      if (i == 0 || score < replace_score) {
         replace_score = score;
-        replace = transp;
+        replace = i;
       }
     }
     return replace;
   }
 
-  __forceinline int getLoad() {
-    return (int)((double)occupied/size*1000);
+  template <typename T>
+  __forceinline static T load(const T& word) {
+    return __atomic_load_n(&word, __ATOMIC_RELAXED);
   }
 
-  int getSizeMb() {
-    return (int)size_mb;
+  template <typename T>
+  __forceinline static void store(T& word, const T value) {
+    __atomic_store_n(&word, value, __ATOMIC_RELAXED);
   }
 
-  __forceinline static uint32_t key32(const uint64_t key) {
-    return key >> 32;
+  // Folds the whole data word into the key bits of the check word.
+  __forceinline static uint32_t fold(uint64_t data) {
+    data ^= data >> 32;
+    data ^= data >> 16;
+    return (uint32_t)data << 16;
   }
 
-protected:
-  Transposition* table;
+  __forceinline static uint16_t metaKey(const uint32_t meta) {
+    return meta >> 16;
+  }
+
+  __forceinline static int metaDepth(const uint32_t meta) {
+    return (meta >> 8) & 0xff;
+  }
+
+  __forceinline static int metaAge(const uint32_t meta) {
+    return (meta >> 3) & 31;
+  }
+
+  __forceinline static int metaFlags(const uint32_t meta) {
+    return meta & 7;
+  }
+
+  __forceinline static void unpack(const uint32_t meta, const uint64_t data, Transposition& transp) {
+    transp.key = metaKey(meta);
+    transp.age = (uint8_t)metaAge(meta);
+    transp.depth = (uint8_t)metaDepth(meta);
+    transp.flags = (uint8_t)metaFlags(meta);
+    transp.move = (Move)(data >> 32);
+    transp.score = (int16_t)(data >> 16);
+    transp.eval = (int16_t)data;
+  }
+
+  TranspositionBucket* table;
   uint64_t mask;
   uint64_t occupied;
   uint64_t size_mb;
+  uint64_t num_buckets;
   uint64_t size;
   int age;
+  int page_mode;
+  bool needs_clear;
+  bool used; // by a search since the last clear
+  std::thread* clearing[64];
+  int num_clearing;
 
-  static const int NUMBER_SLOTS = 4;
+  static const int NUMBER_SLOTS = 5;
+  static const int CACHE_LINE_SIZE = 64;
 };
 
 #pragma pack(1)
@@ -144,7 +292,7 @@ struct PawnEntry {
 
 class PawnStructureTable {
 public:
-  PawnStructureTable(uint64_t  size_mb) : table(NULL) {
+  PawnStructureTable(uint64_t  size_mb) : table(NULL), size(0), page_mode(PAGES_NORMAL) {
     if (sizeof(PawnEntry) != 16) {
       printf("error sizeof(PawnEntry) == %d\n", static_cast<int>(sizeof(PawnEntry)));
       exit(0);
@@ -152,18 +300,34 @@ public:
     initialise(size_mb);
   }
 
+  ~PawnStructureTable() {
+    freeLargePages(table, size*sizeof(PawnEntry));
+  }
+
   void initialise(uint64_t size_mb) {
+    freeLargePages(table, size*sizeof(PawnEntry));
     size = 1024*1024*pow2(log2(size_mb))/sizeof(PawnEntry);
     mask = size - 1;
-    delete [] table;
-    table = new PawnEntry[size];
+    table = (PawnEntry*)allocateLargePages(size*sizeof(PawnEntry), page_mode);
+    if (table == NULL) {
+      printf("error allocating the pawn structure table\n");
+      exit(0);
+    }
     clear();
   }
 
+  const char* getPageMode() {
+    return pageModeString(page_mode);
+  }
+
   __forceinline void clear() {
     memset(table, 0, size*sizeof(PawnEntry));
   }
 
+  __forceinline void prefetch(const uint64_t key) {
+    __builtin_prefetch(table + (key & mask));
+  }
+
   __forceinline PawnEntry* find(const uint64_t key) {
     PawnEntry* pawnp = table + (key & mask);
     if (pawnp->zkey != key || pawnp->zkey == 0) {
@@ -186,6 +350,46 @@ protected:
   PawnEntry* table;
   uint64_t size;
   uint64_t mask;
+  int page_mode;
+};
+
+// Remembers which moves are being searched by some thread right now, so that
+// the other threads can search those moves last (ABDADA).
+class SearchingTable {
+public:
+  SearchingTable() {
+    clear();
+  }
+
+  void clear() {
+    memset(table, 0, sizeof(table));
+  }
+
+  __forceinline bool isSearching(const uint64_t key, const Move move) {
+    uint64_t k = moveKey(key, move);
+    return __atomic_load_n(&table[k & MASK], __ATOMIC_RELAXED) == k;
+  }
+
+  // Returns true when the move was marked. Only then must leave() be called.
+  __forceinline bool enter(const uint64_t key, const Move move) {
+    uint64_t k = moveKey(key, move);
+    uint64_t expected = 0;
+    return __atomic_compare_exchange_n(&table[k & MASK], &expected, k, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+  }
+
+  __forceinline void leave(const uint64_t key, const Move move) {
+    __atomic_store_n(&table[moveKey(key, move) & MASK], 0, __ATOMIC_RELAXED);
+  }
+
+protected:
+  __forceinline static uint64_t moveKey(const uint64_t key, const Move move) {
+    return key ^ (move*0x9e3779b97f4a7c15ull);
+  }
+
+  static const int SIZE = 1 << 15;
+  static const int MASK = SIZE - 1;
+
+  uint64_t table[SIZE];
 };
 
 typedef TranspositionTable TTable;
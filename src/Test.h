@@ -16,6 +16,32 @@
   along with Bobcat.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+// nunn.epd
+static const char* bench_positions[] = {
+  "r2qkb1r/pp1n1ppp/2p2n2/3pp2b/4P3/3P1NPP/PPPN1PB1/R1BQ1RK1 b kq - 0 8",
+  "r2q1rk1/ppp1bppp/1nn1b3/4p3/1P6/P1NP1NP1/4PPBP/R1BQ1RK1 b - - 0 10",
+  "rnbq1rk1/p3ppbp/1p1p1np1/2p5/3P1B2/2P1PN1P/PP2BPP1/RN1QK2R w KQ - 0 8",
+  "r1b1qrk1/ppp1p1bp/n2p1np1/3P1p2/2P5/2N2NP1/PP2PPBP/1RBQ1RK1 b - - 2 9",
+  "rnbq1rk1/1p2ppbp/2pp1np1/p7/P2PP3/2N2N1P/1PP1BPP1/R1BQ1RK1 b - - 0 8",
+  "2kr3r/ppqn1pp1/2pbp2p/7P/3PQ3/5NP1/PPPB1P2/2KR3R w - - 1 16",
+  "r3kb1r/pp2pppp/1nnqb3/8/3p4/NBP2N2/PP3PPP/R1BQ1RK1 b kq - 3 10",
+  "r2qk2r/5pbp/p1npb3/3Np2Q/2B1Pp2/N7/PP3PPP/R4RK1 b kq - 0 15",
+  "r1bqk2r/4bpp1/p2ppn1p/1p6/3BPP2/2N5/PPPQ2PP/2KR1B1R w kq - 0 12",
+  "r1b1k2r/1pq3pp/p1nbpn2/3p4/3P4/2NB1N2/PP3PPP/R1BQ1RK1 w kq - 0 13",
+  "rn1q1rk1/pp3ppp/3b4/3p4/3P2b1/2PB1N2/P4PPP/1RBQ1RK1 b - - 2 12",
+  "r1b1kb1r/ppp2ppp/2p5/4Pn2/8/2N2N2/PPP2PPP/R1B2RK1 w - - 2 10",
+  "r2qrbk1/1b1n1p1p/p2p1np1/1p1Pp3/P1p1P3/2P2NNP/1PB2PP1/R1BQR1K1 w - - 0 17",
+  "r2q1rk1/pp1n1ppp/2p1pnb1/8/PbBPP3/2N2N2/1P2QPPP/R1B2RK1 w - - 1 11",
+  "r1bq1rk1/1p2bppp/p1n1pn2/8/P1BP4/2N2N2/1P2QPPP/R1BR2K1 b - - 2 11",
+  "r1b2rk1/pp3ppp/2n1pn2/q1bp4/2P2B2/P1N1PN2/1PQ2PPP/2KR1B1R b - - 2 10",
+  "rnbq1rk1/2pnppbp/p5p1/1p2P3/3P4/1QN2N2/PP3PPP/R1B1KB1R w KQ - 1 10",
+  "rnb2rk1/ppp1qppp/3p1n2/3Pp3/2P1P3/5NP1/PP1N1PBP/R2Q1RK1 w - - 1 11",
+  "r2q1rk1/pbpn1pp1/1p2pn1p/3p4/2PP3B/P1Q1PP2/1P4PP/R3KBNR w KQ - 1 11",
+  "r3qrk1/1ppb1pbn/n2p2pp/p2Pp3/2P1P2B/P1N5/1P1NBPPP/R2Q1RK1 w - - 1 13",
+};
+
+static const int NUM_BENCH_POSITIONS = sizeof(bench_positions)/sizeof(bench_positions[0]);
+
 struct perft_result
 {
   perft_result()
@@ -81,35 +107,174 @@ public:
     int saved_verbosity = search->verbosity;
     search->verbosity = 0;
     total_time = 0;
-    // nunn.epd
-    timeToDepth("r2qkb1r/pp1n1ppp/2p2n2/3pp2b/4P3/3P1NPP/PPPN1PB1/R1BQ1RK1 b kq - 0 8");
-    timeToDepth("r2q1rk1/ppp1bppp/1nn1b3/4p3/1P6/P1NP1NP1/4PPBP/R1BQ1RK1 b - - 0 10");
-    timeToDepth("rnbq1rk1/p3ppbp/1p1p1np1/2p5/3P1B2/2P1PN1P/PP2BPP1/RN1QK2R w KQ - 0 8");
-    timeToDepth("r1b1qrk1/ppp1p1bp/n2p1np1/3P1p2/2P5/2N2NP1/PP2PPBP/1RBQ1RK1 b - - 2 9");
-    timeToDepth("rnbq1rk1/1p2ppbp/2pp1np1/p7/P2PP3/2N2N1P/1PP1BPP1/R1BQ1RK1 b - - 0 8");
-    timeToDepth("2kr3r/ppqn1pp1/2pbp2p/7P/3PQ3/5NP1/PPPB1P2/2KR3R w - - 1 16");
-    timeToDepth("r3kb1r/pp2pppp/1nnqb3/8/3p4/NBP2N2/PP3PPP/R1BQ1RK1 b kq - 3 10");
-    timeToDepth("r2qk2r/5pbp/p1npb3/3Np2Q/2B1Pp2/N7/PP3PPP/R4RK1 b kq - 0 15");
-    timeToDepth("r1bqk2r/4bpp1/p2ppn1p/1p6/3BPP2/2N5/PPPQ2PP/2KR1B1R w kq - 0 12");
-    timeToDepth("r1b1k2r/1pq3pp/p1nbpn2/3p4/3P4/2NB1N2/PP3PPP/R1BQ1RK1 w kq - 0 13");
-    timeToDepth("rn1q1rk1/pp3ppp/3b4/3p4/3P2b1/2PB1N2/P4PPP/1RBQ1RK1 b - - 2 12");
-    timeToDepth("r1b1kb1r/ppp2ppp/2p5/4Pn2/8/2N2N2/PPP2PPP/R1B2RK1 w - - 2 10");
-    timeToDepth("r2qrbk1/1b1n1p1p/p2p1np1/1p1Pp3/P1p1P3/2P2NNP/1PB2PP1/R1BQR1K1 w - - 0 17");
-    timeToDepth("r2q1rk1/pp1n1ppp/2p1pnb1/8/PbBPP3/2N2N2/1P2QPPP/R1B2RK1 w - - 1 11");
-    timeToDepth("r1bq1rk1/1p2bppp/p1n1pn2/8/P1BP4/2N2N2/1P2QPPP/R1BR2K1 b - - 2 11");
-    timeToDepth("r1b2rk1/pp3ppp/2n1pn2/q1bp4/2P2B2/P1N1PN2/1PQ2PPP/2KR1B1R b - - 2 10");
-    timeToDepth("rnbq1rk1/2pnppbp/p5p1/1p2P3/3P4/1QN2N2/PP3PPP/R1B1KB1R w KQ - 1 10");
-    timeToDepth("rnb2rk1/ppp1qppp/3p1n2/3Pp3/2P1P3/5NP1/PP1N1PBP/R2Q1RK1 w - - 1 11");
-    timeToDepth("r2q1rk1/pbpn1pp1/1p2pn1p/3p4/2PP3B/P1Q1PP2/1P4PP/R3KBNR w KQ - 1 11");
-    timeToDepth("r3qrk1/1ppb1pbn/n2p2pp/p2Pp3/2P1P2B/P1N5/1P1NBPPP/R2Q1RK1 w - - 1 13");
-    printf("%f\n", total_time);
+    total_nodes = 0;
+    total_probes = 0;
+    total_hits = 0;
+#if defined(SEARCH_STATS)
+    printf("      time         nodes  tt hits\n");
+#else
+    printf("      time         nodes\n");
+#endif
+    for (int i = 0; i < NUM_BENCH_POSITIONS; i++) {
+      timeToDepth(bench_positions[i]);
+    }
+#if defined(SEARCH_STATS)
+    printTimeToDepth(total_time, total_nodes, total_hits, total_probes);
+#else
+    printTimeToDepth(total_time, total_nodes);
+#endif
+    printf("nps %" PRIu64 "\n", nps(total_nodes, total_time));
+    search->verbosity = saved_verbosity;
+  }
+
+  // Searches the bench positions to a fixed depth from an empty table. The
+  // total node count is the signature of the search: with one thread it only
+  // changes when the search itself changes.
+  //
+  // With counters the hardware counters of the master thread are reported
+  // per node searched by the master.
+  void bench(Search* search, ProtocolListener* app, int depth, int threads, int hash_mb, bool json,
+             PerfCounters* counters)
+  {
+    this->app = app;
+    this->search = search;
+    int saved_verbosity = search->verbosity;
+    search->verbosity = 0;
+    total_time = 0;
+    total_nodes = 0;
+    total_probes = 0;
+    total_hits = 0;
+    uint64_t nodes[NUM_BENCH_POSITIONS];
+    double seconds[NUM_BENCH_POSITIONS];
+    uint64_t master_nodes = 0;
+
+    if (!json) {
+      printf("Position     time(ms)         nodes          nps\n");
+    }
+    for (int i = 0; i < NUM_BENCH_POSITIONS; i++) {
+      uint64_t nodes_before = total_nodes;
+      double time_before = total_time;
+      if (counters) {
+        counters->start();
+      }
+      timeToDepth(bench_positions[i], depth, false);
+      if (counters) {
+        counters->stop();
+      }
+      master_nodes += search->node_count;
+      nodes[i] = total_nodes - nodes_before;
+      seconds[i] = total_time - time_before;
+      if (!json) {
+        printf("%8d %12.1f %13" PRIu64 " %12" PRIu64 "\n", i + 1, seconds[i]*1000, nodes[i],
+               nps(nodes[i], seconds[i]));
+      }
+    }
+    if (json) {
+      printf("{\n  \"depth\": %d,\n  \"threads\": %d,\n  \"hash\": %d,\n  \"positions\": [\n",
+             depth, threads, hash_mb);
+      for (int i = 0; i < NUM_BENCH_POSITIONS; i++) {
+        printf("    {\"fen\": \"%s\", \"nodes\": %" PRIu64 ", \"time_ms\": %.1f, \"nps\": %" PRIu64 "}%s\n",
+               bench_positions[i], nodes[i], seconds[i]*1000, nps(nodes[i], seconds[i]),
+               i < NUM_BENCH_POSITIONS - 1 ? "," : "");
+      }
+      printf("  ],\n  \"nodes\": %" PRIu64 ",\n  \"time_ms\": %.1f,\n  \"nps\": %" PRIu64,
+             total_nodes, total_time*1000, nps(total_nodes, total_time));
+      if (counters) {
+        printf(",\n  \"counters_per_node\": ");
+        if (counters->numAvailable()) {
+          counters->printJson(counters->totals(), master_nodes);
+        }
+        else {
+          printf("null");
+        }
+      }
+      printf("\n}\n");
+    }
+    else {
+      printf("\nDepth %d, %d thread(s), %d MB hash\n", depth, threads, hash_mb);
+      printf("Total time (ms) : %.1f\n", total_time*1000);
+      printf("Nodes/second    : %" PRIu64 "\n", nps(total_nodes, total_time));
+      printf("Signature       : %" PRIu64 "\n", total_nodes);
+      if (counters && counters->numAvailable()) {
+        printf("\n");
+        counters->print(counters->totals(), master_nodes, "node");
+      }
+      else if (counters) {
+        printf("\nPerformance counters are not available: %s\n", counters->errorString());
+      }
+    }
+    search->verbosity = saved_verbosity;
+  }
+
+  // Runs the bench positions at 1, 2, 4, ... max_threads threads through the
+  // normal Threads option and compares each run with the single thread run.
+  void scaling(Search* search, ProtocolListener* app, int depth, int max_threads, bool json)
+  {
+    this->app = app;
+    this->search = search;
+    int saved_verbosity = search->verbosity;
+    search->verbosity = 0;
+    int threads[8];
+    uint64_t nodes[8];
+    double seconds[8];
+    int num_runs = 0;
+
+    for (int n = 1; num_runs < 8; n = std::min(2*n, max_threads)) {
+      char value[12];
+      snprintf(value, sizeof(value), "%d", n);
+      app->setOption("Threads", value);
+      total_time = 0;
+      total_nodes = 0;
+      for (int i = 0; i < NUM_BENCH_POSITIONS; i++) {
+        timeToDepth(bench_positions[i], depth, false);
+      }
+      threads[num_runs] = n;
+      nodes[num_runs] = total_nodes;
+      seconds[num_runs] = total_time;
+      num_runs++;
+      if (!json) {
+        if (num_runs == 1) {
+          printf("Threads     time(ms)         nodes          nps  nps speedup  ttd speedup  node overhead\n");
+        }
+        printf("%7d %12.1f %13" PRIu64 " %12" PRIu64 " %12.2f %12.2f %14.2f\n", n, total_time*1000, total_nodes,
+               nps(total_nodes, total_time), (double)nps(total_nodes, total_time)/nps(nodes[0], seconds[0]),
+               seconds[0]/std::max(0.001, total_time), (double)total_nodes/nodes[0]);
+      }
+      if (n == max_threads) {
+        break;
+      }
+    }
+    if (json) {
+      printf("{\n  \"depth\": %d,\n  \"runs\": [\n", depth);
+      for (int i = 0; i < num_runs; i++) {
+        printf("    {\"threads\": %d, \"nodes\": %" PRIu64 ", \"time_ms\": %.1f, \"nps\": %" PRIu64 ", "
+               "\"nps_speedup\": %.3f, \"ttd_speedup\": %.3f, \"node_overhead\": %.3f}%s\n",
+               threads[i], nodes[i], seconds[i]*1000, nps(nodes[i], seconds[i]),
+               (double)nps(nodes[i], seconds[i])/nps(nodes[0], seconds[0]), seconds[0]/std::max(0.001, seconds[i]),
+               (double)nodes[i]/nodes[0], i < num_runs - 1 ? "," : "");
+      }
+      printf("  ]\n}\n");
+    }
     search->verbosity = saved_verbosity;
   }
 
 private:
   double total_time;
+  uint64_t total_nodes;
+  uint64_t total_probes;
+  uint64_t total_hits;
+
+  static double hitRate(uint64_t hits, uint64_t probes)
+  {
+    return probes ? 100.0*hits/probes : 0;
+  }
+
+  static uint64_t nps(uint64_t nodes, double seconds)
+  {
+    return (uint64_t)(nodes/std::max(0.001, seconds));
+  }
 
-  void timeToDepth(const char* fen, int depth = 12)
+  void timeToDepth(const char* fen, int depth = 12, bool print = true)
   {
     app->newGame();
     app->setFen(fen);
@@ -119,9 +284,33 @@ private:
     Stopwatch sw;
     search->protocol->handleInput(p, 3);
     double seconds = sw.millisElapsed()/(double)1000;
-    printf("%f\n", seconds);
+#if defined(SEARCH_STATS)
+    if (print) {
+      printTimeToDepth(seconds, search->totalNodes(), search->stats.tt_hits, search->stats.tt_probes);
+    }
+    total_probes += search->stats.tt_probes;
+    total_hits += search->stats.tt_hits;
+#else
+    if (print) {
+      printTimeToDepth(seconds, search->totalNodes());
+    }
+#endif
     total_time += seconds;
+    total_nodes += search->totalNodes();
+  }
+
+  // The hit rate of the master's probes is only counted with -DSEARCH_STATS.
+#if defined(SEARCH_STATS)
+  void printTimeToDepth(double seconds, uint64_t nodes, uint64_t hits, uint64_t probes)
+  {
+    printf("%f %13" PRIu64 "  %5.1f%%\n", seconds, nodes, hitRate(hits, probes));
+  }
+#else
+  void printTimeToDepth(double seconds, uint64_t nodes)
+  {
+    printf("%f %13" PRIu64 "\n", seconds, nodes);
   }
+#endif
 
   int perft_(int depth, perft_result& result)
   {
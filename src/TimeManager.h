@@ -0,0 +1,104 @@
+/*
+  This file is part of Bobcat.
+  Copyright 2008-2015 Gunnar Harms
+
+  Bobcat is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Bobcat is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Bobcat.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <atomic>
+
+// Splits the clock into a soft limit, looked at between iterations and
+// stretched or shortened by how settled the search is, and a hard limit at
+// which the supervisor stops the search whatever its state.
+class TimeManager {
+public:
+  TimeManager() : move_overhead(50), soft_limit(0), hard_limit(0) {
+  }
+
+  void initialise(int time_left, int time_inc, int movestogo, int movetime) {
+    instability = 0;
+    last_score = NO_SCORE;
+
+    if (movetime) {
+      fixed = true;
+      soft_limit = hard_limit = std::max(1, movetime - move_overhead);
+      return;
+    }
+    fixed = false;
+
+    int moves_left = movestogo > 0 ? std::min(movestogo, MOVES_LEFT) : MOVES_LEFT;
+    int available = std::max(1, time_left - move_overhead);
+    int soft = available/moves_left + time_inc*3/4;
+
+    hard_limit = std::max(1, std::min(soft*HARD_RATIO, available*4/5));
+    soft_limit = std::min(soft, (int)hard_limit);
+  }
+
+  // Called after each completed iteration with the number of times the best
+  // root move changed during it, its score and the share of the iteration's
+  // nodes that went into the best move. Returns true if there is no time
+  // for another iteration.
+  bool iterationDone(uint64_t elapsed, int best_move_changes, int score, double best_move_share) {
+    if (fixed) {
+      return false;
+    }
+    instability = instability/2 + best_move_changes;
+
+    double factor = 1 + 0.5*instability;
+
+    if (last_score != NO_SCORE && score < last_score) {
+      factor *= 1 + std::min(last_score - score, 100)/100.0;
+    }
+    factor *= 1.5 - best_move_share;
+    factor = std::max(0.4, std::min(3.0, factor));
+
+    last_score = score;
+    return elapsed >= soft_limit*factor;
+  }
+
+  // Pondering time was free, so the limits count from the ponderhit.
+  void ponderHit(uint64_t elapsed) {
+    soft_limit += (int)elapsed;
+    hard_limit += (int)elapsed;
+  }
+
+  int getSoftLimit() const {
+    return soft_limit;
+  }
+
+  int getHardLimit() const {
+    return hard_limit;
+  }
+
+  void setMoveOverhead(int millis) {
+    move_overhead = millis;
+  }
+
+  int getMoveOverhead() const {
+    return move_overhead;
+  }
+
+protected:
+  int move_overhead;
+  std::atomic<int> soft_limit;
+  std::atomic<int> hard_limit;
+  bool fixed;
+  double instability;
+  int last_score;
+
+  static const int MOVES_LEFT = 30;
+  static const int HARD_RATIO = 4;
+  static const int NO_SCORE = 0x10000;
+};
+
+const int TimeManager::MOVES_LEFT;
@@ -0,0 +1,182 @@
+/*
+  This file is part of Bobcat.
+  Copyright 2008-2015 Gunnar Harms
+
+  Bobcat is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Bobcat is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Bobcat.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+namespace topology
+{
+
+const int MAX_CPUS = 1024;
+
+int num_cpus = 0;
+int num_nodes = 1;
+int cpu_order[MAX_CPUS]; // search thread i is bound to cpu_order[i % num_cpus]
+uint64_t node_mask[MAX_CPUS/64];
+
+struct CpuInfo {
+  int cpu;
+  int node;
+  int package;
+  int core;
+  int sibling;
+};
+
+int readInt(const char* path, int def) {
+  FILE* fp = fopen(path, "r");
+  if (fp == NULL) {
+    return def;
+  }
+  int value;
+  if (fscanf(fp, "%d", &value) != 1) {
+    value = def;
+  }
+  fclose(fp);
+  return value;
+}
+
+// Reads a cpu list like "0-7,16-23" and marks the listed cpus with node.
+bool readNodeCpus(const char* path, int node, int* node_of_cpu) {
+  FILE* fp = fopen(path, "r");
+  if (fp == NULL) {
+    return false;
+  }
+  int first, last;
+  while (fscanf(fp, "%d", &first) == 1) {
+    last = first;
+    int c = fgetc(fp);
+    if (c == '-') {
+      if (fscanf(fp, "%d", &last) != 1) {
+        break;
+      }
+      c = fgetc(fp);
+    }
+    for (int cpu = first; cpu <= last && cpu < MAX_CPUS; cpu++) {
+      node_of_cpu[cpu] = node;
+    }
+    if (c != ',') {
+      break;
+    }
+  }
+  fclose(fp);
+  return true;
+}
+
+// Reads the cpu and node layout from /sys. Threads are ordered so that all
+// physical cores are used before any SMT sibling, node after node.
+void initialize() {
+#if defined(__linux__)
+  static CpuInfo cpus[MAX_CPUS];
+  int node_of_cpu[MAX_CPUS];
+  char path[256];
+
+  for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+    node_of_cpu[cpu] = 0;
+  }
+  num_nodes = 0;
+  memset(node_mask, 0, sizeof(node_mask));
+
+  for (int node = 0; node < MAX_CPUS; node++) {
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    if (readNodeCpus(path, node, node_of_cpu)) {
+      node_mask[node/64] |= (uint64_t)1 << (node % 64);
+      num_nodes++;
+    }
+  }
+  num_nodes = std::max(1, num_nodes);
+  num_cpus = 0;
+
+  for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+    int core = readInt(path, -1);
+    if (core == -1) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/online", cpu);
+    if (readInt(path, 1) == 0) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    CpuInfo& info = cpus[num_cpus++];
+    info.cpu = cpu;
+    info.node = node_of_cpu[cpu];
+    info.package = readInt(path, 0);
+    info.core = core;
+    info.sibling = 0;
+
+    for (int i = 0; i < num_cpus - 1; i++) {
+      if (cpus[i].package == info.package && cpus[i].core == info.core) {
+        info.sibling++;
+      }
+    }
+  }
+  std::sort(cpus, cpus + num_cpus, [](const CpuInfo& a, const CpuInfo& b) {
+    if (a.sibling != b.sibling) return a.sibling < b.sibling;
+    if (a.node != b.node) return a.node < b.node;
+    if (a.package != b.package) return a.package < b.package;
+    if (a.core != b.core) return a.core < b.core;
+    return a.cpu < b.cpu;
+  });
+
+  for (int i = 0; i < num_cpus; i++) {
+    cpu_order[i] = cpus[i].cpu;
+  }
+#endif
+}
+
+// Binds the calling thread to the cpu for search thread number thread_index.
+bool bindThread(int thread_index) {
+#if defined(__linux__)
+  if (num_cpus == 0) {
+    return false;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu_order[thread_index % num_cpus], &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+// Allows the calling thread to run on any cpu again.
+void unbindThread() {
+#if defined(__linux__)
+  if (num_cpus == 0) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int i = 0; i < num_cpus; i++) {
+    CPU_SET(cpu_order[i], &set);
+  }
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+// Spreads the pages of memory that has not been touched yet round robin
+// over all nodes. Does nothing on a single node machine.
+void interleave(void* mem, size_t size) {
+#if defined(__linux__) && defined(SYS_mbind)
+  const int MPOL_INTERLEAVE_MODE = 3;
+
+  if (num_nodes < 2 || mem == NULL) {
+    return;
+  }
+  syscall(SYS_mbind, mem, size, MPOL_INTERLEAVE_MODE, node_mask, (unsigned long)MAX_CPUS + 1, 0);
+#endif
+}
+
+}//namespace topology
@@ -84,6 +84,102 @@ const char* FENfromParams(const char* params[], int num_params, int& param, char
   return fen;
 }
 
+const int PAGES_NORMAL = 0;
+const int PAGES_HUGE = 1;
+const int PAGES_TRANSPARENT_HUGE = 2;
+
+const char* pageModeString(int mode) {
+  static const char* mode_strings[] = { "normal pages", "huge pages", "transparent huge pages" };
+  return mode_strings[mode];
+}
+
+size_t largePageSize(size_t size) {
+  const size_t huge_page_size = 2*1024*1024;
+  return (size + huge_page_size - 1) & ~(huge_page_size - 1);
+}
+
+#if defined(MADV_HUGEPAGE)
+// madvise accepts MADV_HUGEPAGE even when transparent huge pages are turned
+// off, so the active mode, the one in brackets, is read from sysfs.
+bool transparentHugePagesEnabled() {
+  FILE* file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+  if (file == NULL) {
+    return false;
+  }
+  char buf[128];
+  bool enabled = fgets(buf, sizeof(buf), file) && (strstr(buf, "[always]") || strstr(buf, "[madvise]"));
+  fclose(file);
+  return enabled;
+}
+#endif
+
+// Allocates zeroed memory for the hash tables, backed by 2 MB pages when the
+// system allows it. Sets mode to the kind of pages that were obtained.
+void* allocateLargePages(size_t size, int& mode) {
+  void* mem;
+  size = largePageSize(size);
+#if !defined(_WIN32)
+#if defined(MAP_HUGETLB)
+  mem = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+  if (mem != MAP_FAILED) {
+    mode = PAGES_HUGE;
+    return mem;
+  }
+#endif
+  mem = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    return NULL;
+  }
+  mode = PAGES_NORMAL;
+#if defined(MADV_HUGEPAGE)
+  if (madvise(mem, size, MADV_HUGEPAGE) == 0 && transparentHugePagesEnabled()) {
+    mode = PAGES_TRANSPARENT_HUGE;
+  }
+#endif
+#else
+  if (GetLargePageMinimum()) {
+    mem = VirtualAlloc(NULL, size, MEM_RESERVE|MEM_COMMIT|MEM_LARGE_PAGES, PAGE_READWRITE);
+    if (mem) {
+      mode = PAGES_HUGE;
+      return mem;
+    }
+  }
+  mem = VirtualAlloc(NULL, size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+  mode = PAGES_NORMAL;
+#endif
+  return mem;
+}
+
+void freeLargePages(void* mem, size_t size) {
+  if (mem == NULL) {
+    return;
+  }
+#if !defined(_WIN32)
+  munmap(mem, largePageSize(size));
+#else
+  VirtualFree(mem, 0, MEM_RELEASE);
+#endif
+}
+
+// Allocates memory with the given alignment. Before C++17 new does not
+// honour alignments larger than the default one.
+void* allocateAligned(size_t size, size_t alignment) {
+#if !defined(_WIN32)
+  void* mem;
+  return posix_memalign(&mem, alignment, size) == 0 ? mem : NULL;
+#else
+  return _aligned_malloc(size, alignment);
+#endif
+}
+
+void freeAligned(void* mem) {
+#if !defined(_WIN32)
+  free(mem);
+#else
+  _aligned_free(mem);
+#endif
+}
+
 //#if defined(_MSC_VER)
 
 const char* dateAndTimeString(char* buf) {
@@ -95,13 +191,23 @@ const char* dateAndTimeString(char* buf) {
 }
 
 const char* timeString(char* buf) {
+#if defined(_WIN32)
   struct _timeb tb;
   _ftime (&tb);
   struct tm* time = localtime(&tb.time);
-  sprintf(buf, "%02d:%02d:%02d.%03d", time->tm_hour, time->tm_min, time->tm_sec, tb.millitm);
+  int millis = tb.millitm;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  struct tm* time = localtime(&ts.tv_sec);
+  int millis = (int)(ts.tv_nsec/1000000);
+#endif
+  sprintf(buf, "%02d:%02d:%02d.%03d", time->tm_hour, time->tm_min, time->tm_sec, millis);
   return buf;
 }
 
+#if defined(_WIN32)
+
 class Stopwatch
 {
 public:
@@ -139,6 +245,13 @@ public:
     return (now.QuadPart - start1_.QuadPart)*1000/frequency_.QuadPart;
   }
 
+  __forceinline uint64_t nanosElapsedHighRes() const
+  {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((now.QuadPart - start1_.QuadPart)*(1000000000.0/frequency_.QuadPart));
+  }
+
   __forceinline uint64_t millisElapsed() const
   {
     return GetTickCount64() - start2_;
@@ -147,3 +260,59 @@ public:
 
 LARGE_INTEGER Stopwatch::frequency_;
 static Stopwatch stopwatch_init(1);
+
+#else
+
+class Stopwatch
+{
+public:
+  uint64_t start_;
+
+  Stopwatch()
+  {
+    start();
+  }
+
+  __forceinline void start()
+  {
+    start_ = nanos();
+  }
+
+  __forceinline uint64_t microsElapsedHighRes() const
+  {
+    return (nanos() - start_)/1000;
+  }
+
+  __forceinline uint64_t millisElapsedHighRes() const
+  {
+    return (nanos() - start_)/1000000;
+  }
+
+  __forceinline uint64_t nanosElapsedHighRes() const
+  {
+    return nanos() - start_;
+  }
+
+  __forceinline uint64_t millisElapsed() const
+  {
+    return millisElapsedHighRes();
+  }
+
+  static __forceinline uint64_t nanos()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+  }
+};
+
+#endif
+
+// Reads the time stamp counter, or returns 0 where there is none.
+__forceinline uint64_t cycleCounter() {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
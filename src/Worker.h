@@ -16,32 +16,110 @@
   along with Bobcat.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 
 class Worker {
 public:
-  void start(Game* master, TTable* transt, PSTable* pawnt) {
-    game_ = new Game();
+  Worker() : game_(NULL), eval_(NULL), see_(NULL), search_(NULL), thread_(NULL), ready_(false), searching_(false),
+    exit_(false)
+  {
+  }
+
+  ~Worker() {
+    exit();
+  }
+
+  void initialise(TTable* transt, PSTable* pawnt, int thread_index, bool bind) {
+    if (thread_) {
+      return;
+    }
+    thread_ = new std::thread(&Worker::idleLoop, this, transt, pawnt, thread_index, bind);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return ready_; });
+  }
+
+  void start(Game* master) {
     game_->copy(master);
-    see_ = new See(game_);
-    eval_ = new Eval(*game_, pawnt);
-    search_ = new Search(game_, eval_, see_, transt);
-    thread_ = new std::thread(&Search::run, search_);
+    search_->stop_search = false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    searching_ = true;
+    cond_.notify_one();
   }
 
   void stop() {
     search_->stop();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return !searching_; });
+  }
+
+  Search* getSearch() {
+    return search_;
+  }
+
+  void exit() {
+    if (thread_ == NULL) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      exit_ = true;
+      cond_.notify_one();
+    }
     thread_->join();
     delete thread_;
     delete search_;
     delete eval_;
     delete see_;
     delete game_;
+    thread_ = NULL;
+    ready_ = false;
+    exit_ = false;
   }
 
 private:
+  // Parks the thread between searches so that threads and search state are
+  // created once per process instead of once per move. The search state is
+  // created by the thread itself, after binding, so it is local to its node.
+  void idleLoop(TTable* transt, PSTable* pawnt, int thread_index, bool bind) {
+    if (bind) {
+      topology::bindThread(thread_index);
+    }
+    game_ = new Game();
+    game_->setTables(transt, pawnt);
+    see_ = new See(game_);
+    eval_ = new Eval(*game_, pawnt);
+    search_ = new Search(game_, eval_, see_, transt, thread_index);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_ = true;
+    cond_.notify_one();
+
+    while (true) {
+      cond_.wait(lock, [this] { return searching_ || exit_; });
+
+      if (exit_) {
+        return;
+      }
+      lock.unlock();
+      search_->run();
+      lock.lock();
+      searching_ = false;
+      cond_.notify_one();
+    }
+  }
+
   Game* game_;
   Eval* eval_;
   See* see_;
   Search* search_;
   std::thread* thread_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool ready_;
+  bool searching_;
+  bool exit_;
 };